@@ -0,0 +1,600 @@
+﻿/* Copyright 2024 The Kingsoft's modern-string Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "ks_string.h"
+#include "ks_string_util.h"
+#include "ks_string_memory_pool.h"
+#include "ks_string_memory_huge.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+
+static volatile size_t g_bench_sink = 0;
+
+template <class FN>
+static double __bench_seconds(FN&& fn) {
+    auto t0 = std::chrono::steady_clock::now();
+    fn();
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(t1 - t0).count();
+}
+
+static void __bench_report(const char* title, size_t ops, double seconds) {
+    std::cout << "  " << std::left << std::setw(44) << title
+        << std::right << std::setw(10) << std::fixed << std::setprecision(1) << (ops / seconds / 1e6) << " M ops/s"
+        << std::setw(10) << std::setprecision(3) << (seconds * 1e3) << " ms\n";
+}
+
+
+//allocs/sec of the slab pool against plain malloc, on the common 16~512 element range
+static void bench_memory_pool() {
+    std::cout << "[memory-pool] alloc+free of 16~512 bytes blocks:\n";
+
+    constexpr size_t batch = 256;
+    constexpr size_t rounds = 20000;
+    std::vector<size_t> sizes(batch);
+    for (size_t i = 0; i < batch; ++i)
+        sizes[i] = 8 + 16 + (i * 97) % (512 - 16);
+    std::vector<void*> ptrs(batch);
+
+    double malloc_secs = __bench_seconds([&]() {
+        for (size_t r = 0; r < rounds; ++r) {
+            for (size_t i = 0; i < batch; ++i)
+                ptrs[i] = malloc(sizes[i]);
+            g_bench_sink += (size_t)ptrs[r % batch];
+            for (size_t i = 0; i < batch; ++i)
+                free(ptrs[i]);
+        }
+    });
+    __bench_report("malloc/free", batch * rounds, malloc_secs);
+
+    double pool_secs = __bench_seconds([&]() {
+        for (size_t r = 0; r < rounds; ++r) {
+            for (size_t i = 0; i < batch; ++i)
+                ptrs[i] = ks_string_memory_pool::allocate(sizes[i]);
+            g_bench_sink += (size_t)ptrs[r % batch];
+            for (size_t i = 0; i < batch; ++i)
+                ks_string_memory_pool::deallocate(ptrs[i], sizes[i]);
+        }
+    });
+    __bench_report("ks_string_memory_pool", batch * rounds, pool_secs);
+
+    //cross-thread: allocated by producer, freed by consumer
+    auto cross_thread_run = [&](bool use_pool) -> double {
+        constexpr size_t cross_rounds = 2000;
+        std::vector<std::vector<void*>> handoff(cross_rounds, std::vector<void*>(batch));
+        return __bench_seconds([&]() {
+            std::thread producer([&]() {
+                for (size_t r = 0; r < cross_rounds; ++r)
+                    for (size_t i = 0; i < batch; ++i)
+                        handoff[r][i] = use_pool ? ks_string_memory_pool::allocate(sizes[i]) : malloc(sizes[i]);
+            });
+            producer.join();
+            std::thread consumer([&]() {
+                for (size_t r = 0; r < cross_rounds; ++r)
+                    for (size_t i = 0; i < batch; ++i)
+                        use_pool ? ks_string_memory_pool::deallocate(handoff[r][i], sizes[i]) : free(handoff[r][i]);
+            });
+            consumer.join();
+        });
+    };
+    __bench_report("malloc/free (cross-thread)", batch * 2000, cross_thread_run(false));
+    __bench_report("ks_string_memory_pool (cross-thread)", batch * 2000, cross_thread_run(true));
+}
+
+//split/substr heavy workload, goes through the string allocator (pooled if MODERN_STRING_POOL_ENABLED)
+static void bench_split_substr() {
+#ifdef MODERN_STRING_POOL_ENABLED
+    std::cout << "[split-substr] (pool enabled):\n";
+#else
+    std::cout << "[split-substr] (pool disabled):\n";
+#endif
+
+    std::vector<ks_immutable_string> lines;
+    for (size_t i = 0; i < 1000; ++i) {
+        ks_mutable_string line;
+        for (size_t j = 0; j < 16; ++j) {
+            if (j != 0)
+                line.append(",");
+            line.append(ks_string_util::to_string(i * 1000003 + j * 7919).view());
+            line.append("-field-value");
+        }
+        lines.push_back(line.to_immutable());
+    }
+
+    constexpr size_t rounds = 200;
+    size_t ops = 0;
+    double secs = __bench_seconds([&]() {
+        for (size_t r = 0; r < rounds; ++r) {
+            for (auto& line : lines) {
+                ks_mutable_string joined;
+                for (auto& field : line.split(",")) {
+                    ks_mutable_string upper = field.substr(0, 24).to_mutable();
+                    upper.set_at(0, 'x');
+                    joined.append(upper.view());
+                    ++ops;
+                }
+                g_bench_sink += joined.length();
+            }
+        }
+    });
+    __bench_report("split + substr + set_at + append", ops, secs);
+}
+
+//copy-heavy split/substr, the refcount is changed by atomic RMW (shareable) or plain instructions (thread-confined)
+template <class IMMUTABLE_STRING>
+static double __bench_copy_heavy_split(const std::vector<std::string>& lines, size_t rounds, size_t* ops) {
+    std::vector<IMMUTABLE_STRING> src_lines;
+    for (auto& line : lines)
+        src_lines.push_back(IMMUTABLE_STRING(ks_string_view(line.data(), line.length())));
+
+    return __bench_seconds([&]() {
+        for (size_t r = 0; r < rounds; ++r) {
+            for (auto& line : src_lines) {
+                std::vector<IMMUTABLE_STRING> fields = line.split(",");
+                std::vector<IMMUTABLE_STRING> copies = fields;
+                for (auto& field : copies) {
+                    IMMUTABLE_STRING head = field.substr(0, 16);
+                    g_bench_sink += head.length();
+                    ++*ops;
+                }
+            }
+        }
+    });
+}
+
+static void bench_local_refcount() {
+    std::cout << "[local-refcount] split + copy + substr of shared buffers:\n";
+
+    std::vector<std::string> lines;
+    for (size_t i = 0; i < 1000; ++i) {
+        std::string line;
+        for (size_t j = 0; j < 16; ++j) {
+            if (j != 0)
+                line.append(",");
+            line.append(std::to_string(i * 1000003 + j * 7919));
+            line.append("-field-value");
+        }
+        lines.push_back(line);
+    }
+
+    constexpr size_t rounds = 200;
+    size_t shared_ops = 0, local_ops = 0;
+    double shared_secs = __bench_copy_heavy_split<ks_immutable_string>(lines, rounds, &shared_ops);
+    __bench_report("ks_immutable_string (atomic refcount)", shared_ops, shared_secs);
+    double local_secs = __bench_copy_heavy_split<ks_local_immutable_string>(lines, rounds, &local_ops);
+    __bench_report("ks_local_immutable_string (plain refcount)", local_ops, local_secs);
+}
+
+//hot keys copied by many threads, the refcount line is bounced between cores unless the buffer is immortal
+static void bench_immortal() {
+    const size_t thread_count = std::max(2u, std::min(8u, std::thread::hardware_concurrency()));
+    std::cout << "[immortal] copy + drop a hot shared key by " << thread_count << " threads:\n";
+
+    constexpr size_t rounds = 2000000;
+    auto shared_copy_run = [&](bool immortal) -> double {
+        ks_immutable_string hot_key(ks_string_view("config.section.hot-shared-key"));
+        if (immortal)
+            hot_key.make_immortal();
+        return __bench_seconds([&]() {
+            std::vector<std::thread> threads;
+            for (size_t t = 0; t < thread_count; ++t) {
+                threads.emplace_back([&]() {
+                    size_t sum = 0;
+                    for (size_t r = 0; r < rounds; ++r) {
+                        ks_immutable_string copy = hot_key;
+                        sum += copy.length();
+                    }
+                    g_bench_sink += sum;
+                });
+            }
+            for (auto& thread : threads)
+                thread.join();
+        });
+    };
+    __bench_report("ks_immutable_string (atomic refcount)", rounds * thread_count, shared_copy_run(false));
+    __bench_report("ks_immutable_string (immortal)", rounds * thread_count, shared_copy_run(true));
+}
+
+//decoding record batches, one allocation per field or one per record
+static void bench_bulk() {
+    std::cout << "[bulk] make 100 fields (16~48 bytes) per record:\n";
+
+    std::vector<std::string> fields;
+    for (size_t i = 0; i < 100; ++i)
+        fields.push_back(std::string(16 + (i * 7) % 32, char('a' + i % 26)));
+
+    constexpr size_t rounds = 50000;
+    double single_secs = __bench_seconds([&]() {
+        for (size_t r = 0; r < rounds; ++r) {
+            std::vector<ks_immutable_string> record;
+            record.reserve(fields.size());
+            for (auto& field : fields)
+                record.push_back(ks_immutable_string(ks_string_view(field.data(), field.length())));
+            g_bench_sink += record.size();
+        }
+    });
+    __bench_report("ks_immutable_string per field", rounds * fields.size(), single_secs);
+
+    double bulk_secs = __bench_seconds([&]() {
+        for (size_t r = 0; r < rounds; ++r) {
+            std::vector<ks_immutable_string> record = ks_string_util::bulk_strings(fields.begin(), fields.end());
+            g_bench_sink += record.size();
+        }
+    });
+    __bench_report("ks_string_util::bulk_strings", rounds * fields.size(), bulk_secs);
+}
+
+//request-scoped text processing, with and without arena
+static void bench_arena() {
+    std::cout << "[arena] build and drop 1000 strings per request:\n";
+
+    constexpr size_t requests = 2000;
+    auto run_request = [](size_t r) -> size_t {
+        std::vector<ks_immutable_string> parts;
+        parts.reserve(1000);
+        for (size_t i = 0; i < 1000; ++i) {
+            ks_mutable_string s("request-scoped-text-");
+            s.append(ks_string_util::to_string(r * 1000 + i).view());
+            parts.push_back(std::move(s).to_immutable());
+        }
+        return ks_string_util::join(parts.begin(), parts.end(), ",").length();
+    };
+
+    double heap_secs = __bench_seconds([&]() {
+        for (size_t r = 0; r < requests; ++r)
+            g_bench_sink += run_request(r);
+    });
+    __bench_report("heap", requests * 1000, heap_secs);
+
+    double arena_secs = __bench_seconds([&]() {
+        for (size_t r = 0; r < requests; ++r) {
+            ks_string_memory_arena arena;
+            g_bench_sink += run_request(r);
+        }
+    });
+    __bench_report("ks_string_memory_arena", requests * 1000, arena_secs);
+}
+
+//append-heavy loops, the exclusive buffer grows by realloc (maybe in place)
+static void bench_append_growth() {
+    std::cout << "[append] grow strings to 1 MiB by push_back / 16 bytes append:\n";
+
+    constexpr size_t total = 1024 * 1024;
+    constexpr size_t rounds = 50;
+    const char piece[] = "0123456789abcdef";
+
+    double std_push_secs = __bench_seconds([&]() {
+        for (size_t r = 0; r < rounds; ++r) {
+            std::string s;
+            for (size_t i = 0; i < total; ++i)
+                s.push_back(char('a' + i % 26));
+            g_bench_sink += s.length();
+        }
+    });
+    __bench_report("std::string push_back", total * rounds, std_push_secs);
+
+    double ks_push_secs = __bench_seconds([&]() {
+        for (size_t r = 0; r < rounds; ++r) {
+            ks_mutable_string s;
+            for (size_t i = 0; i < total; ++i)
+                s.push_back(char('a' + i % 26));
+            g_bench_sink += s.length();
+        }
+    });
+    __bench_report("ks_mutable_string push_back", total * rounds, ks_push_secs);
+
+    double std_append_secs = __bench_seconds([&]() {
+        for (size_t r = 0; r < rounds; ++r) {
+            std::string s;
+            for (size_t i = 0; i < total / 16; ++i)
+                s.append(piece, 16);
+            g_bench_sink += s.length();
+        }
+    });
+    __bench_report("std::string append", total / 16 * rounds, std_append_secs);
+
+    double ks_append_secs = __bench_seconds([&]() {
+        for (size_t r = 0; r < rounds; ++r) {
+            ks_mutable_string s;
+            for (size_t i = 0; i < total / 16; ++i)
+                s.append(ks_string_view(piece, 16));
+            g_bench_sink += s.length();
+        }
+    });
+    __bench_report("ks_mutable_string append", total / 16 * rounds, ks_append_secs);
+}
+
+//grow a string to 1 GiB by 64 KiB appends, the huge path grows by mremap instead of malloc+copy
+static long __bench_page_faults() {
+#ifndef _WIN32
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt + usage.ru_majflt;
+#else
+    return 0;
+#endif
+}
+
+static void bench_huge_append() {
+    std::cout << "[huge] append 1 GiB in 64 KiB chunks (huge-threshold: " << ks_string_memory_huge::HUGE_THRESHOLD << "):\n";
+
+    constexpr size_t chunk_size = 64 * 1024;
+    constexpr size_t chunks = 16 * 1024;
+    const std::string chunk(chunk_size, 'x');
+
+    auto run = [&](const char* title, auto&& append_all) {
+        long faults0 = __bench_page_faults();
+        double secs = __bench_seconds(append_all);
+        long faults = __bench_page_faults() - faults0;
+        std::cout << "  " << std::left << std::setw(44) << title
+            << std::right << std::setw(10) << std::fixed << std::setprecision(3) << (secs * 1e3) << " ms"
+            << std::setw(12) << faults << " faults\n";
+    };
+
+    run("std::string", [&]() {
+        std::string s;
+        for (size_t i = 0; i < chunks; ++i)
+            s.append(chunk);
+        g_bench_sink += s.length();
+    });
+
+    run("ks_mutable_string", [&]() {
+        ks_mutable_string s;
+        for (size_t i = 0; i < chunks; ++i)
+            s.append(ks_string_view(chunk.data(), chunk.length()));
+        g_bench_sink += s.length();
+    });
+}
+
+
+//keys of a realistic corpus (short ids, config keys, uuids, urls) kept by string types of 16, 32 and 48 bytes,
+//the memory per key is the string object plus its heap block (with the buffer header), which is what the rss grows by (besides the malloc overhead)
+struct __bench_counting_memory {
+    static size_t alloc_count;
+    static size_t live_bytes;
+    static void* allocate(size_t size) { ++alloc_count; live_bytes += size; return ks_string_default_memory::allocate(size); }
+    static void deallocate(void* p, size_t size) noexcept { live_bytes -= size; ks_string_default_memory::deallocate(p, size); }
+};
+size_t __bench_counting_memory::alloc_count = 0;
+size_t __bench_counting_memory::live_bytes = 0;
+
+template <class ELEM>
+static std::vector<std::vector<ELEM>> __bench_key_corpus(size_t count) {
+    static const char* const prefixes[] = { "user.", "config.section.", "tag:", "https://example.com/item/", "" };
+    std::vector<std::vector<ELEM>> corpus;
+    corpus.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        std::string key;
+        switch (i % 5) {
+        case 0: key = "id" + std::to_string(i); break; //short ids
+        case 1: key = std::string(prefixes[0]) + "name" + std::to_string(i % 977); break; //identifiers
+        case 2: key = std::string(prefixes[1]) + "key" + std::to_string(i % 131); break; //config keys
+        case 3: { //uuids
+            char uuid[40];
+            snprintf(uuid, sizeof(uuid), "%08x-%04x-%04x-%04x-%012llx", unsigned(i * 2654435761u), unsigned(i % 65536), 0x4000u | unsigned(i % 4096), 0x8000u | unsigned(i % 16384), (unsigned long long)i * 11400714819323198485ull % 0xFFFFFFFFFFFFull);
+            key = uuid;
+            break;
+        }
+        default: key = std::string(prefixes[3]) + std::to_string(i); break; //urls
+        }
+        corpus.push_back(std::vector<ELEM>(key.begin(), key.end()));
+    }
+    return corpus;
+}
+
+template <class ELEM, size_t SSO_FIX_SIZE>
+static void __bench_sso_size_run(const std::vector<std::vector<ELEM>>& corpus) {
+    using string_type = ks_basic_immutable_string<ELEM, ks_basic_string_sso_allocator<ELEM, SSO_FIX_SIZE, ks_basic_string_allocator<ELEM, __bench_counting_memory>>>;
+    __bench_counting_memory::alloc_count = 0;
+    const size_t live_bytes0 = __bench_counting_memory::live_bytes;
+    std::vector<string_type> keys;
+    double secs = __bench_seconds([&]() {
+        keys.reserve(corpus.size());
+        for (auto& key : corpus)
+            keys.push_back(string_type(key.data(), key.size()));
+    });
+    const size_t memory_bytes = sizeof(string_type) * keys.size() + (__bench_counting_memory::live_bytes - live_bytes0);
+    g_bench_sink += keys.size();
+
+    std::string title = std::string(sizeof(ELEM) == 1 ? "char" : "WCHAR") + " keys, " + std::to_string(SSO_FIX_SIZE) + " bytes (" + std::to_string((SSO_FIX_SIZE - 2) / sizeof(ELEM) - 1) + " inline)";
+    std::cout << "  " << std::left << std::setw(44) << title
+        << std::right << std::setw(10) << std::fixed << std::setprecision(1) << (corpus.size() / secs / 1e6) << " M keys/s"
+        << std::setw(8) << std::setprecision(2) << (double(__bench_counting_memory::alloc_count) / corpus.size()) << " allocs/key"
+        << std::setw(8) << std::setprecision(1) << (double(memory_bytes) / corpus.size()) << " bytes/key\n";
+}
+
+static void bench_sso_size() {
+    constexpr size_t key_count = 1000000;
+    std::cout << "[sso-size] keep " << key_count << " keys (ids, identifiers, config keys, uuids, urls):\n";
+
+    const auto corpus = __bench_key_corpus<char>(key_count);
+    __bench_sso_size_run<char, 16>(corpus);
+    __bench_sso_size_run<char, 32>(corpus);
+    __bench_sso_size_run<char, 48>(corpus);
+
+    const auto wcorpus = __bench_key_corpus<WCHAR>(key_count);
+    __bench_sso_size_run<WCHAR, 16>(wcorpus);
+    __bench_sso_size_run<WCHAR, 32>(wcorpus);
+    __bench_sso_size_run<WCHAR, 48>(wcorpus);
+}
+
+//tight view() scans over strings of mixed sso and ref modes (in random order, so the mode is unpredictable)
+static void bench_view_scan() {
+    std::cout << "[view scan] view() based scans over 1M short strings (half sso, half ref):\n";
+
+    constexpr size_t count = 1000000;
+    std::vector<ks_immutable_string> strs;
+    strs.reserve(count);
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < count; ++i) {
+        seed = seed * 1664525 + 1013904223;
+        const size_t len = (seed >> 16) % 2 == 0 ? 4 + (seed >> 20) % 9 : 14 + (seed >> 20) % 18; //sso: 4~12, ref: 14~31
+        strs.push_back(ks_immutable_string(len, char('a' + (seed >> 24) % 26)));
+    }
+
+    constexpr size_t rounds = 20;
+    double length_secs = __bench_seconds([&]() {
+        size_t sum = 0;
+        for (size_t r = 0; r < rounds; ++r) {
+            for (auto& str : strs)
+                sum += str.view().length();
+        }
+        g_bench_sink += sum;
+    });
+    __bench_report("sum of view().length()", rounds * count, length_secs);
+
+    double last_secs = __bench_seconds([&]() {
+        size_t sum = 0;
+        for (size_t r = 0; r < rounds; ++r) {
+            for (auto& str : strs) {
+                ks_string_view view = str.view();
+                sum += size_t(view.data()[view.length() - 1]);
+            }
+        }
+        g_bench_sink += sum;
+    });
+    __bench_report("sum of view() last chars", rounds * count, last_secs);
+
+    double match_secs = __bench_seconds([&]() {
+        size_t sum = 0;
+        for (size_t r = 0; r < rounds; ++r) {
+            for (auto& str : strs)
+                sum += str.view().starts_with(ks_string_view("mm")) ? 1 : 0;
+        }
+        g_bench_sink += sum;
+    });
+    __bench_report("count of view().starts_with()", rounds * count, match_secs);
+}
+
+//short keys (all in sso) in hash maps and sorting, where ==, compare and hash are the hot paths
+static void bench_sso_keys() {
+    std::cout << "[sso keys] 100000 short keys (4~13 chars):\n";
+
+    constexpr size_t count = 100000;
+    std::vector<ks_immutable_string> keys, probes;
+    keys.reserve(count);
+    probes.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        std::string key = "k" + std::to_string(i * 2654435761u % 1000000007u);
+        key.resize(4 + i % 10, '_');
+        keys.push_back(ks_immutable_string(ks_string_view(key.data(), key.length())));
+        probes.push_back(ks_immutable_string(ks_string_view(key.data(), key.length()))); //equal, but not the same object
+    }
+
+    std::unordered_map<ks_immutable_string, size_t> map;
+    for (size_t i = 0; i < count; ++i)
+        map.emplace(keys[i], i);
+
+    constexpr size_t rounds = 20;
+    double find_secs = __bench_seconds([&]() {
+        size_t sum = 0;
+        for (size_t r = 0; r < rounds; ++r) {
+            for (auto& probe : probes)
+                sum += map.find(probe)->second;
+        }
+        g_bench_sink += sum;
+    });
+    __bench_report("unordered_map::find", rounds * count, find_secs);
+
+    double hash_secs = __bench_seconds([&]() {
+        size_t sum = 0;
+        for (size_t r = 0; r < rounds; ++r) {
+            for (auto& probe : probes)
+                sum += std::hash<ks_immutable_string>()(probe);
+        }
+        g_bench_sink += sum;
+    });
+    __bench_report("std::hash", rounds * count, hash_secs);
+
+    double sort_secs = __bench_seconds([&]() {
+        std::vector<ks_immutable_string> sorted = keys;
+        std::sort(sorted.begin(), sorted.end());
+        g_bench_sink += sorted.front().length();
+    });
+    __bench_report("std::sort", count, sort_secs);
+}
+
+
+template <class STR_TYPE>
+static void __bench_sso_mutation_run(const char* title, const std::vector<std::string>& words, size_t rounds) {
+    __bench_counting_memory::alloc_count = 0;
+    double secs = __bench_seconds([&]() {
+        size_t sum = 0;
+        for (size_t r = 0; r < rounds; ++r) {
+            for (auto& word : words) {
+                STR_TYPE s(word.data(), word.length());
+                for (size_t i = 0; i < s.length(); ++i) { //to_lower
+                    char ch = s.at(i);
+                    if (ch >= 'A' && ch <= 'Z')
+                        s.set_at(i, char(ch - 'A' + 'a'));
+                }
+                s.erase(1, 1);
+                s.insert(0, "_");
+                s.replace(1, 2, "xy");
+                sum += s.length();
+            }
+        }
+        g_bench_sink += sum;
+    });
+
+    std::cout << "  " << std::left << std::setw(44) << title
+        << std::right << std::setw(10) << std::fixed << std::setprecision(1) << (rounds * words.size() / secs / 1e6) << " M words/s"
+        << std::setw(8) << std::setprecision(2) << (double(__bench_counting_memory::alloc_count) / (rounds * words.size())) << " allocs/word\n";
+}
+
+static void bench_sso_mutation() {
+    std::cout << "[sso mutation] to_lower/erase/insert/replace on 100000 short words (3~12 chars):\n";
+
+    constexpr size_t count = 100000;
+    std::vector<std::string> words;
+    words.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        std::string word = "Wd" + std::to_string(i * 2654435761u % 1000000007u);
+        word.resize(3 + i % 10, 'X');
+        words.push_back(word);
+    }
+
+    constexpr size_t rounds = 10;
+    using mutable_type = ks_basic_mutable_string<char, ks_basic_string_allocator<char, __bench_counting_memory>>;
+    __bench_sso_mutation_run<mutable_type>("ks_mutable_string", words, rounds);
+}
+
+int main() {
+    bench_memory_pool();
+    bench_split_substr();
+    bench_local_refcount();
+    bench_immortal();
+    bench_bulk();
+    bench_arena();
+    bench_append_growth();
+    bench_huge_append();
+    bench_sso_size();
+    bench_view_scan();
+    bench_sso_keys();
+    bench_sso_mutation();
+    return 0;
+}
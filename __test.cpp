@@ -15,7 +15,43 @@ limitations under the License.
 
 #include "ks_string.h"
 #include "ks_string_util.h"
+#include "ks_string_dedup.h"
 #include <iostream>
+#include <cstdio>
+#include <thread>
+#include <atomic>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+
+//a custom raw memory for string buffers, which counts the live bytes
+struct __test_counting_memory {
+    static size_t live_bytes;
+    static void* allocate(size_t size) { live_bytes += size; return ks_string_default_memory::allocate(size); }
+    static void deallocate(void* p, size_t size) noexcept { live_bytes -= size; ks_string_default_memory::deallocate(p, size); }
+};
+size_t __test_counting_memory::live_bytes = 0;
+
+//uses the slab pool at thread exit, after the thread-local pool has been torn down (so the fallback pool is used)
+struct __test_pool_exit_user {
+    bool* served = nullptr;
+    ~__test_pool_exit_user() {
+        if (served == nullptr)
+            return;
+        void* p = ks_string_memory_pool::allocate(40);
+        void* p2 = ks_string_memory_pool::allocate(40);
+        memset(p, 'a', 40);
+        memset(p2, 'b', 40);
+        *served = p != p2 && uintptr_t(p) % 16 == 0 && uintptr_t(p2) % 16 == 0 && ((char*)p)[39] == 'a';
+        ks_string_memory_pool::deallocate(p, 40);
+        ks_string_memory_pool::deallocate(p2, 40);
+    }
+};
+static thread_local __test_pool_exit_user tls_pool_exit_user;
 
 
 int main() {
@@ -102,6 +138,15 @@ int main() {
     ms9.resize(2);
     std::cout << "ms9.resize(2): " << ms9 << "\n";
 
+    {
+        ks_immutable_string heap_str(ks_mutable_string(40, 'h'));
+        ks_immutable_string moved_from = heap_str;
+        ks_immutable_string moved_to = std::move(moved_from); //moved_from is sso now, but keeps the stale pointer bytes
+        moved_from = heap_str; //must addref, though the stale pointer is the same
+        moved_to = ks_immutable_string();
+        std::cout << "copy-assign to moved-from: exclusive " << heap_str.is_exclusive() << "\n";
+    }
+
     size_t h1 = std::hash<ks_mutable_string>{}(ms1);
     size_t h2 = std::hash<ks_immutable_string>{}(ims1);
     std::cout << "h1: " << h1 << "\n";
@@ -121,6 +166,10 @@ int main() {
     std::cout << "ims10(join): " << ims10 << "\n";
     std::cout << "ims10a(concat): " << ims10a << "\n";
 
+    const char* record_fields[] = { "record-field-number-one", "record-field-number-two", "f3" };
+    std::vector<ks_immutable_string> bulk_fields = ks_string_util::bulk_strings(std::begin(record_fields), std::end(record_fields)); //one allocation
+    std::cout << "bulk: " << bulk_fields[0] << ", " << bulk_fields[1] << ", " << bulk_fields[2] << "\n";
+
     std::cout << "parse-int 100: " << ks_string_util::parse_int("100") << "\n";
     std::cout << "parse-double 100.2: " << ks_string_util::parse_double("100.2") << "\n";
     std::cout << "parse-bool true: " << ks_string_util::parse_bool("true") << "\n";
@@ -140,6 +189,366 @@ int main() {
     std::cout << "convert wide: " << ks_string_util::wstring_to_std_native_string(ks_string_util::wstring_from_native_wide_chars(ks_string_util::wstring_to_std_native_wide_string((WCHAR*)u"大家好呀呀").c_str(), -1)) << "\n";
 #endif
 
+    ks_immutable_string ims11;
+    {
+        ks_string_memory_arena arena;
+        ks_mutable_string ms11("string buffers allocated in arena");
+        ms11.append(", and released all together");
+        std::vector<ks_immutable_string> ms11_subs = ms11.split(" ");
+        std::cout << "arena: " << ms11 << " (" << ms11_subs.size() << " subs, " << arena.allocated_bytes() << " bytes)\n";
+
+        ks_string_memory_arena::heap_scope heap_scope; //the copy made here can escape the arena
+        ims11 = ks_immutable_string(ms11.view());
+    }
+    std::cout << "ims11(escaped from arena): " << ims11 << "\n";
+
+    {
+        using counting_allocator = ks_basic_string_allocator<char, __test_counting_memory>;
+        ks_basic_mutable_string<char, counting_allocator> ms12("string with custom allocator");
+        ms12.append(", routed to counting memory");
+        ks_basic_immutable_string<char, counting_allocator> ims12 = ms12.substr(7, 4);
+        std::cout << "ms12: " << ms12 << ", ims12: " << ims12 << ", live-bytes: " << __test_counting_memory::live_bytes << "\n";
+    }
+    std::cout << "live-bytes of counting memory: " << __test_counting_memory::live_bytes << "\n";
+
+    {
+        using counting_allocator = ks_basic_string_allocator<char, __test_counting_memory>;
+        std::vector<ks_basic_immutable_string<char, counting_allocator>> kept_strs, released_strs;
+        for (int i = 0; i < 200; ++i) {
+            kept_strs.push_back(ks_basic_immutable_string<char, counting_allocator>(ks_basic_mutable_string<char, counting_allocator>(32, 'r')));
+            released_strs.push_back(kept_strs.back());
+        }
+        std::thread([&]() { released_strs.clear(); }).join(); //queued to this thread if biased, beyond the preallocated queue
+        ks_string_biased_refcount::perform_queued_releases();
+        kept_strs.clear();
+        std::cout << "released by another thread: live-bytes " << __test_counting_memory::live_bytes << "\n";
+    }
+
+    ks_mutable_string ms13("formatted: ");
+    ms13.resize_and_overwrite(ms13.length() + 32, [](char* p, size_t count) -> size_t {
+        return 11 + snprintf(p + 11, count - 11, "%d-%s", 42, "written directly");
+    });
+    std::cout << "ms13(resize_and_overwrite): " << ms13 << "\n";
+
+    {
+        ks_immutable_string big_doc(ks_mutable_string(100 * 1024, 'd'));
+        ks_immutable_string pinning_slice = big_doc.substr(100, 40);
+        ks_string_slice_policy::set_copy_out_ratio(16);
+        ks_immutable_string copied_out_slice = big_doc.substr(100, 40);
+        ks_string_slice_policy::set_copy_out_ratio(0);
+        std::cout << "slice pinned-bytes: " << pinning_slice.pinned_bytes() << " (shared), " << copied_out_slice.pinned_bytes() << " (copied-out)\n";
+
+        ks_string_slice_policy::set_compact_ratio(4);
+        big_doc = ks_immutable_string();
+        ks_immutable_string compacted_slice = std::move(pinning_slice);
+        compacted_slice.compact(); //the last owner
+        ks_string_slice_policy::set_compact_ratio(0);
+        std::cout << "slice pinned-bytes: " << compacted_slice.pinned_bytes() << " (compacted on last owner)\n";
+
+        //the last but one owner is released by another thread
+        ks_immutable_string big_doc2(ks_mutable_string(100 * 1024, 'e'));
+        ks_immutable_string pinning_slice2 = big_doc2.substr(100, 40);
+        ks_string_slice_policy::set_compact_ratio(4);
+        std::thread([](ks_immutable_string doc) { doc = ks_immutable_string(); }, std::move(big_doc2)).join();
+        pinning_slice2.compact();
+        ks_string_slice_policy::set_compact_ratio(0);
+        std::cout << "slice pinned-bytes: " << pinning_slice2.pinned_bytes() << " (compacted on last owner, released by another thread)\n";
+
+        //the last but one owner is referenced and released by another thread
+        ks_immutable_string big_doc3(ks_mutable_string(100 * 1024, 'f'));
+        ks_immutable_string pinning_slice3 = big_doc3.substr(100, 40);
+        ks_immutable_string* other_thread_owner = nullptr;
+        std::thread([&]() { other_thread_owner = new ks_immutable_string(big_doc3); }).join();
+        big_doc3 = ks_immutable_string();
+        ks_string_slice_policy::set_compact_ratio(4);
+        std::thread([&]() { delete other_thread_owner; }).join();
+        pinning_slice3.compact();
+        ks_string_slice_policy::set_compact_ratio(0);
+        std::cout << "slice pinned-bytes: " << pinning_slice3.pinned_bytes() << " (compacted on last owner, shared with another thread)\n";
+
+        //the last two owners are released by two threads at once, the survivor frees the buffer at once (no touch after it)
+        std::vector<ks_immutable_string> owners_a, owners_b;
+        for (int i = 0; i < 100000; ++i) {
+            owners_a.push_back(ks_immutable_string(ks_mutable_string(32, char('a' + i % 26))));
+            owners_b.push_back(owners_a.back());
+        }
+        std::atomic<int> ready_count(0);
+        auto release_all = [&ready_count](std::vector<ks_immutable_string>& owners) {
+            ready_count.fetch_add(1);
+            while (ready_count.load() != 2)
+                std::this_thread::yield();
+            for (auto& owner : owners)
+                owner = ks_immutable_string();
+        };
+        std::thread release_thread([&]() { release_all(owners_a); });
+        release_all(owners_b);
+        release_thread.join();
+        std::cout << "slice concurrent last-owner release: ok\n";
+    }
+
+    {
+        const uint16_t parser_tag = 1;
+        ks_string_memory_tag::set_soft_limit(parser_tag, 4096);
+        ks_string_memory_tag::set_over_budget_callback([](uint16_t tag, size_t live_bytes, size_t soft_limit) {
+            std::cout << "tag " << tag << " over budget: " << live_bytes << " bytes (soft-limit " << soft_limit << ")\n";
+        });
+
+        ks_string_memory_tag::scope tag_scope(parser_tag);
+        ks_mutable_string ms14(1000, 'p');
+        ks_mutable_string ms15(5000, 'q');
+        std::cout << "tag " << parser_tag << ": " << ks_string_memory_tag::live_bytes(parser_tag) << " live bytes\n";
+    }
+    std::cout << "tag 1: " << ks_string_memory_tag::live_bytes(1) << " live bytes (peak " << ks_string_memory_tag::peak_bytes(1) << ")\n";
+
+    try {
+        ks_string_memory_tag::scope tag_scope(300); //beyond the tag table
+        std::cout << "tag 300: accepted\n";
+    }
+    catch (const std::out_of_range&) {
+        std::cout << "tag 300: rejected\n";
+    }
+
+    {
+        ks_local_immutable_string local_line("thread-confined,fields,copied,without,atomics");
+        std::vector<ks_local_immutable_string> local_fields = local_line.split(",");
+        ks_immutable_string shared_field(std::move(local_fields[0])); //exclusive? adopted : copied
+        ks_immutable_string shared_line(std::move(local_line)); //the buffer is not adopted while the fields share it
+        std::cout << "local fields: " << local_fields.size() << ", shared: " << shared_field << ", " << shared_line << "\n";
+    }
+
+    {
+        ks_immutable_string config_key("config.section.hot-shared-key");
+        config_key.make_immortal(); //copies never touch the refcount since now
+        ks_immutable_string config_key_copy = config_key;
+        ks_immutable_string literal_tail = "literal-tail"_Immut.substr(8);
+        std::cout << "immortal: " << config_key_copy << " (" << config_key_copy.is_immortal() << "), " << literal_tail << " (capacity " << literal_tail.capacity() << ")\n";
+
+        ks_string_immortal_policy::set_promote_refcount(100); //checked at 128
+        ks_string_immortal_policy::set_max_promoted_bytes(128); //one buffer of 64 chars only
+        ks_immutable_string hot_key_a(ks_mutable_string(64, 'a')), hot_key_b(ks_mutable_string(64, 'b'));
+        std::thread([&]() {
+            std::vector<ks_immutable_string> copies(200, hot_key_a);
+            copies.assign(200, hot_key_b);
+        }).join();
+        ks_string_immortal_policy::set_promote_refcount(0);
+        ks_string_immortal_policy::set_max_promoted_bytes(ks_string_immortal_policy::DEFAULT_MAX_PROMOTED_BYTES);
+        std::cout << "promoted: " << hot_key_a.is_immortal() << ", " << hot_key_b.is_immortal() << " (capped), " << ks_string_immortal_policy::promoted_bytes() << " bytes\n";
+    }
+
+    {
+        ks_sso32_immutable_string inline_key("config.section.inline-key");
+        ks_immutable_string heap_key(inline_key); //converted, 13 chars inline only
+        std::cout << "sso32: " << inline_key << " (" << sizeof(inline_key) << " bytes, capacity " << inline_key.capacity() << "), "
+            << heap_key << " (" << sizeof(heap_key) << " bytes, capacity " << heap_key.capacity() << ")\n";
+    }
+
+    {
+        ks_wide_immutable_string wide_log("wide-layout:64-bit,offsets,and,lengths");
+        std::vector<ks_wide_immutable_string> wide_fields = wide_log.substr(12).split(",");
+        ks_immutable_string compact_field(wide_fields[0]); //converted across the layouts by copying
+        std::cout << "wide: " << wide_fields.size() << " fields, " << compact_field << " at " << wide_log.find("64-bit")
+            << " (" << sizeof(wide_log) << " bytes)\n";
+    }
+
+    {
+        ks_aligned_immutable_string aligned_key("aligned-sso");
+        ks_immutable_string default_key(aligned_key); //the same layout, only the alignment differs
+        std::cout << "aligned: " << default_key << ", align " << alignof(ks_immutable_string) << " (default), " << alignof(ks_aligned_immutable_string)
+            << " (aligned), " << sizeof(ks_aligned_immutable_string) << " bytes\n";
+    }
+
+    {
+        ks_mutable_string sso_key("key-0042!!");
+        sso_key.resize(8); //the cut off chars are zeroed, so the sso keys are compared and hashed in words
+        ks_immutable_string heap_key = ks_immutable_string("prefix:key-0042").substr(7); //the same content in ref-mode
+        std::cout << "sso keys: " << (sso_key == ks_mutable_string("key-0042")) << ", " << sso_key.compare(ks_mutable_string("key-0043"))
+            << ", " << (std::hash<ks_mutable_string>()(sso_key) == std::hash<ks_immutable_string>()(heap_key)) << "\n";
+    }
+
+    {
+        ks_mutable_string sso_str("hello");
+        const char* sso_data = sso_str.data();
+        sso_str.set_at(0, 'j'); //the sso storage is exclusive, so it's mutated in place instead of forked to heap
+        sso_str.replace(4, 1, "y");
+        std::cout << "sso mutate: " << sso_str << ", inline " << (sso_str.data() == sso_data) << "\n";
+    }
+
+    {
+        //the tail behind pos must be shifted to the new end, in both sso and heap strings
+        const char* const digits = "0123456789";
+        const char* const letters = "abcdefghijklmnopqrstuvwxyz";
+        std::cout << "insert middle: " << ks_mutable_string(digits).insert(2, "AB") << ", " << ks_mutable_string(digits).insert(2, 3, '#')
+            << ", " << ks_mutable_string(letters).insert(2, "AB") << ", " << ks_mutable_string(letters).insert(2, 3, '#') << "\n";
+        std::cout << "replace middle: " << ks_mutable_string(digits).replace(5, 1, "ABC") << ", " << ks_mutable_string(digits).replace(5, 1, 3, '#')
+            << ", " << ks_mutable_string(letters).replace(5, 1, "ABC") << ", " << ks_mutable_string(letters).replace(5, 1, 3, '#') << "\n";
+    }
+
+    {
+        static const char external_data[] = "external-buffer:adopted,without,copy";
+        size_t released_size = 0;
+        {
+            ks_immutable_string external = ks_immutable_string::from_external(external_data, sizeof(external_data) - 1,
+                [](const void* p, size_t size, void* ctx) { *(size_t*)ctx = size; }, &released_size);
+            std::vector<ks_immutable_string> external_fields = external.substr(16).split(",");
+            ks_mutable_string external_copy = external; //forked, the external buffer has no end-ch0
+            std::cout << "external: " << external_fields.size() << " fields, " << external_copy.c_str() << ", live " << ks_string_external_buffer::live_count();
+        }
+        std::cout << ", released " << released_size << "\n";
+    }
+
+    {
+        const char* mapped_path = "modern-string-test.mapped.txt";
+        if (FILE* mapped_fp = fopen(mapped_path, "wb")) {
+            fputs("mapped-file:line1\nline2\nline3\n", mapped_fp);
+            fclose(mapped_fp);
+            {
+                ks_immutable_string mapped = ks_string_util::map_file(mapped_path);
+                std::vector<ks_immutable_string> mapped_lines = mapped.substr(12).trimmed().split("\n");
+                std::cout << "mapped: " << mapped.length() << " bytes, " << mapped_lines.size() << " lines, live " << ks_string_external_buffer::live_count() << "\n";
+            }
+            remove(mapped_path); //unmapped already
+        }
+    }
+
+    {
+        std::vector<ks_immutable_string> repeated_urls;
+        for (int i = 0; i < 100; ++i)
+            repeated_urls.push_back(ks_immutable_string(i % 2 == 0 ? "https://example.com/repeated/url/even" : "https://example.com/repeated/url/odd"));
+        ks_string_dedup dedup;
+        for (auto& url : repeated_urls)
+            dedup.add(&url);
+        dedup.flush();
+        dedup.apply();
+        bool arena_url_added = true;
+        {
+            ks_string_memory_arena arena;
+            ks_immutable_string arena_url("https://example.com/repeated/url/even");
+            arena_url_added = dedup.add(&arena_url); //released by the arena, it must not be kept by the canonical table
+        }
+        std::cout << "dedup: " << dedup.deduplicated_count() << " strings re-pointed, " << dedup.reclaimed_bytes() << " bytes reclaimed, "
+            << (repeated_urls[0].data() == repeated_urls[98].data()) << ", arena-url added " << arena_url_added << "\n";
+
+        ks_immutable_string big_page(ks_mutable_string(1024 * 1024, 'x'));
+        ks_immutable_string page_slice = big_page.substr(100, 64);
+        ks_immutable_string standalone_str(ks_mutable_string(64, 'x'));
+        big_page = ks_immutable_string();
+        dedup.add(&page_slice); //the canonical one is copied out, instead of pinning the page
+        dedup.add(&standalone_str);
+        dedup.flush();
+        dedup.apply();
+        std::cout << "dedup of a slice: pinned-bytes " << standalone_str.pinned_bytes() << ", " << page_slice.pinned_bytes() << "\n";
+
+        const uint16_t dedup_tag = 2;
+        std::vector<ks_immutable_string> tagged_strs;
+        {
+            ks_string_memory_tag::scope tag_scope(dedup_tag);
+            for (int i = 0; i < 4; ++i)
+                tagged_strs.push_back(ks_immutable_string(ks_mutable_string(64, 't')));
+        }
+        for (auto& str : tagged_strs)
+            dedup.add(&str);
+        dedup.flush();
+        dedup.apply();
+        tagged_strs.clear(); //then the canonical buffer is referred by the dedup table only
+        dedup.apply();
+        dedup.flush(); //the prune is done
+        std::cout << "dedup pruned: " << ks_string_memory_tag::live_bytes(dedup_tag) << " live bytes of tag " << dedup_tag << "\n";
+    }
+
+#if defined(__linux__)
+    {
+        ks_string_shared_arena shared_arena = ks_string_shared_arena::create(4096);
+        const ks_string_shared_arena::offset_type shared_offset = shared_arena.add("shared-arena:built-once,read-by-all-workers");
+        std::cout.flush();
+        const pid_t worker_pid = fork();
+        if (worker_pid == 0) {
+            ks_string_shared_arena attached_arena = ks_string_shared_arena::attach(shared_arena.fd()); //the fd is inherited
+            ks_immutable_string shared_str = attached_arena.string_at(shared_offset);
+            _exit(shared_str.view() == ks_string_view("shared-arena:built-once,read-by-all-workers") ? 0 : 1);
+        }
+        int worker_status = -1;
+        waitpid(worker_pid, &worker_status, 0);
+        std::cout << "shared-arena: " << shared_arena.string_at(shared_offset) << ", worker " << (WIFEXITED(worker_status) && WEXITSTATUS(worker_status) == 0 ? "ok" : "failed") << "\n";
+
+        bool tail_offset_rejected = false;
+        try {
+            (void)shared_arena.view_at(ks_string_shared_arena::offset_type(shared_arena.used_bytes() - sizeof(uint32_t))); //no room for an entry
+        }
+        catch (const std::out_of_range&) {
+            tail_offset_rejected = true;
+        }
+        std::cout << "shared-arena: tail offset rejected " << tail_offset_rejected << "\n";
+
+        //a corrupt used field (written by a hostile creator) never lets the reads out of the mapping
+        void* raw_mapping = mmap(nullptr, shared_arena.capacity(), PROT_READ | PROT_WRITE, MAP_SHARED, shared_arena.fd(), 0);
+        ((std::atomic<uint64_t>*)raw_mapping)[2].store(uint64_t(1) << 40); //the used field of the header
+        bool corrupt_attach_rejected = false;
+        try {
+            (void)ks_string_shared_arena::attach(shared_arena.fd());
+        }
+        catch (const std::runtime_error&) {
+            corrupt_attach_rejected = true;
+        }
+        std::cout << "shared-arena: corrupt used clamped to " << shared_arena.used_bytes() << ", attach rejected " << corrupt_attach_rejected << "\n";
+        munmap(raw_mapping, shared_arena.capacity());
+
+        ks_string_shared_arena moved_arena = std::move(shared_arena);
+        bool moved_from_rejected = false;
+        try {
+            (void)shared_arena.view_at(shared_offset);
+        }
+        catch (const std::out_of_range&) {
+            moved_from_rejected = true;
+        }
+        std::cout << "shared-arena: moved-from capacity " << shared_arena.capacity() << ", used " << shared_arena.used_bytes() << ", view rejected " << moved_from_rejected << "\n";
+    }
+#endif
+
+    {
+        std::cout << "pool size-classes: " << ks_string_memory_pool::block_size_of(1) << ", " << ks_string_memory_pool::block_size_of(17)
+            << ", " << ks_string_memory_pool::block_size_of(129) << ", " << ks_string_memory_pool::block_size_of(1000) << ", " << ks_string_memory_pool::block_size_of(4096) << "\n";
+
+        void* local_block = ks_string_memory_pool::allocate(100);
+        ks_string_memory_pool::deallocate(local_block, 100);
+        const bool local_reused = ks_string_memory_pool::allocate(100) == local_block; //the local-list is LIFO
+        ks_string_memory_pool::deallocate(local_block, 100);
+
+        void* remote_block = ks_string_memory_pool::allocate(4000);
+        std::thread([remote_block]() { ks_string_memory_pool::deallocate(remote_block, 4000); }).join(); //onto the owner's remote-list
+        std::vector<void*> drained_blocks;
+        bool remote_reused = false;
+        while (!remote_reused && drained_blocks.size() < 1000) {
+            drained_blocks.push_back(ks_string_memory_pool::allocate(4000)); //the remote-list is taken when the local-list is empty
+            remote_reused = drained_blocks.back() == remote_block;
+        }
+        for (void* block : drained_blocks)
+            ks_string_memory_pool::deallocate(block, 4000);
+
+        bool fallback_served = false;
+        std::thread([&fallback_served]() {
+            tls_pool_exit_user.served = &fallback_served; //constructed before the thread-local pool, so destructed after it
+            ks_string_memory_pool::deallocate(ks_string_memory_pool::allocate(40), 40);
+        }).join();
+        std::cout << "pool reuse: local " << local_reused << ", remote " << remote_reused << ", fallback " << fallback_served << "\n";
+    }
+
+    {
+        ks_mutable_string grown_str;
+        for (int i = 0; i < 5000; ++i)
+            grown_str.push_back(char('a' + i % 26)); //reallocated across the pooled, malloc and huge sizes (by the build options)
+        bool grown_ok = grown_str.length() == 5000;
+        for (int i = 0; grown_ok && i < 5000; ++i)
+            grown_ok = grown_str[i] == char('a' + i % 26);
+        std::cout << "grown by push_back: " << grown_str.length() << " chars, " << (grown_ok ? "ok" : "corrupted") << "\n";
+    }
+
+    ks_string_memory_stats stats = ks_string_util::get_memory_stats();
+    if (stats.enabled) {
+        std::cout << "memory-stats: " << stats.live_buffer_count << " buffers, " << stats.live_bytes << " bytes (peak " << stats.peak_bytes << "), "
+            << stats.alloc_count << " allocs, " << stats.free_count << " frees, "
+            << stats.shared_slice_count << " shared slices (" << stats.shared_slice_pinned_bytes << " pinned bytes), " << stats.copied_out_slice_count << " copied-out slices\n";
+    }
+
     //ks_mutable_string ms10;
     //std::cout << "please input ms10: ";
     //std::cin >> ms10;
@@ -19,9 +19,9 @@ limitations under the License.
 #include "ks_basic_xmutable_string_base.h"
 
 
-template <class ELEM>
-class MODERN_STRING_API ks_basic_immutable_string : public ks_basic_xmutable_string_base<ELEM> {
-	using __my_string_base = ks_basic_xmutable_string_base<ELEM>;
+template <class ELEM, class ALLOC /*= ks_basic_string_allocator<ELEM>*/>
+class MODERN_STRING_API ks_basic_immutable_string : public ks_basic_xmutable_string_base<ELEM, ALLOC> {
+	using __my_string_base = ks_basic_xmutable_string_base<ELEM, ALLOC>;
 	using __my_string_base::__to_basic_string_view;
 
 public:
@@ -60,15 +60,23 @@ public:
 	ks_basic_immutable_string& operator=(ks_basic_immutable_string&& other) noexcept = default;
 
 	//copy & move ctor (from xmutable)
-	ks_basic_immutable_string(const ks_basic_xmutable_string_base<ELEM>& other) 
+	ks_basic_immutable_string(const ks_basic_xmutable_string_base<ELEM, ALLOC>& other) 
 		: __my_string_base(other) {}
-	ks_basic_immutable_string(const ks_basic_xmutable_string_base<ELEM>& other, size_t offset, size_t count = -1)
+	ks_basic_immutable_string(const ks_basic_xmutable_string_base<ELEM, ALLOC>& other, size_t offset, size_t count = -1)
 		: __my_string_base(other.do_substr(offset, count)) {}
-	ks_basic_immutable_string(ks_basic_xmutable_string_base<ELEM>&& other) 
+	ks_basic_immutable_string(ks_basic_xmutable_string_base<ELEM, ALLOC>&& other) 
 		: __my_string_base(other.do_detach()) { ASSERT(other.is_detached_empty()); }
-	ks_basic_immutable_string(ks_basic_xmutable_string_base<ELEM>&& other, size_t offset, size_t count = -1)
+	ks_basic_immutable_string(ks_basic_xmutable_string_base<ELEM, ALLOC>&& other, size_t offset, size_t count = -1)
 		: __my_string_base(other.do_detach().do_substr(offset, count)) { ASSERT(other.is_detached_empty()); }
 
+	//explicit copy & move ctor (from another ALLOC policy, e.g. ks_local_xxx_string to the shareable one)
+	template <class ALLOC2, class _ = std::enable_if_t<!std::is_same_v<ALLOC2, ALLOC>>>
+	explicit ks_basic_immutable_string(const ks_basic_xmutable_string_base<ELEM, ALLOC2>& other)
+		: __my_string_base(other) {}
+	template <class ALLOC2, class _ = std::enable_if_t<!std::is_same_v<ALLOC2, ALLOC>>>
+	explicit ks_basic_immutable_string(ks_basic_xmutable_string_base<ELEM, ALLOC2>&& other)
+		: __my_string_base(std::move(other)) {}
+
 	//copy & move ctor (from std::basic_string)
 	template <class CharTraits, class AllocType>
 	ks_basic_immutable_string(const std::basic_string<ELEM, CharTraits, AllocType>& str) 
@@ -77,20 +85,53 @@ public:
 	ks_basic_immutable_string(const std::basic_string<ELEM, CharTraits, AllocType>& str, size_t offset, size_t count = -1)
 		: __my_string_base(__to_basic_string_view(str, offset, count)) {}
 
-	ks_basic_immutable_string(std::basic_string<ELEM, ks_char_traits<ELEM>, ks_basic_string_allocator<ELEM>>&& str_rvref)
+	ks_basic_immutable_string(std::basic_string<ELEM, ks_char_traits<ELEM>, ALLOC>&& str_rvref)
 		: __my_string_base(std::move(str_rvref)) {}
-	ks_basic_immutable_string(std::basic_string<ELEM, ks_char_traits<ELEM>, ks_basic_string_allocator<ELEM>>&& str_rvref, size_t offset, size_t count = -1)
+	ks_basic_immutable_string(std::basic_string<ELEM, ks_char_traits<ELEM>, ALLOC>&& str_rvref, size_t offset, size_t count = -1)
 		: __my_string_base(__my_string_base(std::move(str_rvref)).substr(offset, count)) {}
 
 private:
 	using typename __my_string_base::__constant_mark;
 	ks_basic_immutable_string(__constant_mark, const ELEM* sz, size_t length) noexcept : __my_string_base(__constant_mark::v, sz, length) {}
 
+	using typename __my_string_base::__external_mark;
+	ks_basic_immutable_string(__external_mark, const ELEM* p, size_t count, ks_string_external_buffer::release_fn release_fn, void* ctx)
+		: __my_string_base(__external_mark::v, p, count, release_fn, ctx) {}
+
 public:
 	static _NODISCARD ks_basic_immutable_string __constant_of(const ELEM* sz, size_t length) noexcept {
 		return ks_basic_immutable_string(__constant_mark::v, sz, length);
 	}
 
+	//adopt the external buffer of count elements without copy (e.g. a network or mmap-ed buffer), its slices share it as well,
+	//and the release_fn(p, size, ctx) is called when the last of them dies, on that thread. the buffer needs no end-ch0, and must be unchanged until released.
+	//note: a small one is copied into sso string instead, and released at once.
+	static _NODISCARD ks_basic_immutable_string from_external(const ELEM* p, size_t count, ks_string_external_buffer::release_fn release_fn, void* ctx = nullptr) {
+		return ks_basic_immutable_string(__external_mark::v, p, count, release_fn, ctx);
+	}
+
+	//the strings sharing one buffer of total_length (allocated once, and freed when the last of them dies),
+	//the fill_fn(ELEM* p, size_t total_length, std::vector<ks_basic_string_view<ELEM>>& piece_seq) writes the buffer, and appends the subviews of it as the strings.
+	//note: the pieces are never copied out (see also ks_string_slice_policy), and the small ones are sso strings still.
+	template <class FILL_FN>
+	static _NODISCARD std::vector<ks_basic_immutable_string> __bulk_of(size_t total_length, FILL_FN&& fill_fn) {
+		std::vector<ks_basic_string_view<ELEM>> piece_seq;
+		ks_basic_mutable_string<ELEM, ALLOC> bulk_buffer;
+		const ELEM* written_p = nullptr;
+		bulk_buffer.resize_and_overwrite(total_length, [&fill_fn, &piece_seq, &written_p](ELEM* p, size_t count) -> size_t {
+			written_p = p;
+			std::forward<FILL_FN>(fill_fn)(p, count, piece_seq);
+			return count;
+		});
+
+		const ks_basic_immutable_string bulk(std::move(bulk_buffer));
+		for (auto& piece : piece_seq) {
+			ASSERT(piece.data() >= written_p && piece.data() + piece.length() <= written_p + total_length);
+			piece = ks_basic_string_view<ELEM>(bulk.data() + (piece.data() - written_p), piece.length()); //the sso data is moved
+		}
+		return bulk.template do_bulk_substr<ks_basic_immutable_string>(piece_seq, false);
+	}
+
 public:
 	std::vector<ks_basic_immutable_string> split(const ks_basic_string_view<ELEM>& sep, size_t n = -1) const {
 		return this->template do_split<ks_basic_immutable_string>(sep, n);
@@ -125,11 +166,11 @@ public:
 	}
 
 public:
-	ks_basic_mutable_string<ELEM> to_mutable() const& { return ks_basic_mutable_string<ELEM>(*this); }
-	ks_basic_mutable_string<ELEM> to_mutable()&& { return ks_basic_mutable_string<ELEM>(this->detach()); }
+	ks_basic_mutable_string<ELEM, ALLOC> to_mutable() const& { return ks_basic_mutable_string<ELEM, ALLOC>(*this); }
+	ks_basic_mutable_string<ELEM, ALLOC> to_mutable()&& { return ks_basic_mutable_string<ELEM, ALLOC>(this->detach()); }
 
 	ks_basic_immutable_string detach() noexcept { return ks_basic_immutable_string(std::move(*this)); }
-	ks_basic_mutable_string<ELEM> detach_to_mutable() noexcept { return ks_basic_mutable_string<ELEM>(this->detach()); }
+	ks_basic_mutable_string<ELEM, ALLOC> detach_to_mutable() noexcept { return ks_basic_mutable_string<ELEM, ALLOC>(this->detach()); }
 
 public:
 	template <class RIGHT, class _ = std::enable_if_t<std::is_convertible_v<RIGHT, ks_basic_string_view<ELEM>>>>
@@ -153,18 +194,18 @@ public:
 };
 
 
-template <class ELEM, class LEFT, class _ = std::enable_if_t<std::is_convertible_v<LEFT, ks_basic_string_view<ELEM>>>>
-inline ks_basic_immutable_string<ELEM> operator+(const LEFT& left, const ks_basic_immutable_string<ELEM>& right) {
-	ks_basic_immutable_string<ELEM> ret(right);
+template <class ELEM, class ALLOC, class LEFT, class _ = std::enable_if_t<std::is_convertible_v<LEFT, ks_basic_string_view<ELEM>>>>
+inline ks_basic_immutable_string<ELEM, ALLOC> operator+(const LEFT& left, const ks_basic_immutable_string<ELEM, ALLOC>& right) {
+	ks_basic_immutable_string<ELEM, ALLOC> ret(right);
 	const ks_basic_string_view<ELEM> left_view(left);
 	if (!left_view.empty())
 		ret = ret.detach_to_mutable().insert(0, left_view);
 	return ret;
 }
 
-template <class ELEM, class LEFT, class _ = std::enable_if_t<std::is_convertible_v<LEFT, ks_basic_string_view<ELEM>>>>
-inline ks_basic_immutable_string<ELEM> operator+(const LEFT& left, ks_basic_immutable_string<ELEM>&& right) {
-	ks_basic_immutable_string<ELEM> ret(std::move(right));
+template <class ELEM, class ALLOC, class LEFT, class _ = std::enable_if_t<std::is_convertible_v<LEFT, ks_basic_string_view<ELEM>>>>
+inline ks_basic_immutable_string<ELEM, ALLOC> operator+(const LEFT& left, ks_basic_immutable_string<ELEM, ALLOC>&& right) {
+	ks_basic_immutable_string<ELEM, ALLOC> ret(std::move(right));
 	const ks_basic_string_view<ELEM> left_view(left);
 	if (!left_view.empty())
 		ret = ret.detach_to_mutable().insert(0, left_view);
@@ -173,19 +214,19 @@ inline ks_basic_immutable_string<ELEM> operator+(const LEFT& left, ks_basic_immu
 
 
 namespace std {
-	template <class ELEM>
-	inline void swap(ks_basic_immutable_string<ELEM>& l, ks_basic_immutable_string<ELEM>& r) noexcept {
+	template <class ELEM, class ALLOC>
+	inline void swap(ks_basic_immutable_string<ELEM, ALLOC>& l, ks_basic_immutable_string<ELEM, ALLOC>& r) noexcept {
 		l.swap(r);
 	}
 
-	template <class ELEM>
-	struct hash<ks_basic_immutable_string<ELEM>> : hash<ks_basic_xmutable_string_base<ELEM>> {
+	template <class ELEM, class ALLOC>
+	struct hash<ks_basic_immutable_string<ELEM, ALLOC>> : hash<ks_basic_xmutable_string_base<ELEM, ALLOC>> {
 	};
 
 }
 
-template <class ELEM>
-inline std::basic_ostream<ELEM, std::char_traits<ELEM>>& operator<<(std::basic_ostream<ELEM, std::char_traits<ELEM>>& strm, const ks_basic_immutable_string<ELEM>& str) {
+template <class ELEM, class ALLOC>
+inline std::basic_ostream<ELEM, std::char_traits<ELEM>>& operator<<(std::basic_ostream<ELEM, std::char_traits<ELEM>>& strm, const ks_basic_immutable_string<ELEM, ALLOC>& str) {
 	return strm << str.view();
 }
 
@@ -20,9 +20,9 @@ limitations under the License.
 #include <istream>
 
 
-template <class ELEM>
-class MODERN_STRING_API ks_basic_mutable_string : public ks_basic_xmutable_string_base<ELEM> {
-	using __my_string_base = ks_basic_xmutable_string_base<ELEM>;
+template <class ELEM, class ALLOC /*= ks_basic_string_allocator<ELEM>*/>
+class MODERN_STRING_API ks_basic_mutable_string : public ks_basic_xmutable_string_base<ELEM, ALLOC> {
+	using __my_string_base = ks_basic_xmutable_string_base<ELEM, ALLOC>;
 	using __my_string_base::__to_basic_string_view;
 
 public:
@@ -61,15 +61,23 @@ public:
 	ks_basic_mutable_string& operator=(ks_basic_mutable_string&& other) noexcept = default;
 
 	//copy & move ctor (from xmutable)
-	ks_basic_mutable_string(const ks_basic_xmutable_string_base<ELEM>& other) 
+	ks_basic_mutable_string(const ks_basic_xmutable_string_base<ELEM, ALLOC>& other) 
 		: __my_string_base(other) { this->do_ensure_end_ch0(true); }
-	ks_basic_mutable_string(const ks_basic_xmutable_string_base<ELEM>& other, size_t offset, size_t count = -1)
+	ks_basic_mutable_string(const ks_basic_xmutable_string_base<ELEM, ALLOC>& other, size_t offset, size_t count = -1)
 		: __my_string_base(other.do_substr(offset, count)) { this->do_ensure_end_ch0(true); }
-	ks_basic_mutable_string(ks_basic_xmutable_string_base<ELEM>&& other) 
+	ks_basic_mutable_string(ks_basic_xmutable_string_base<ELEM, ALLOC>&& other) 
 		: __my_string_base(other.do_detach()) { ASSERT(other.is_detached_empty()); this->do_ensure_end_ch0(true); }
-	ks_basic_mutable_string(ks_basic_xmutable_string_base<ELEM>&& other, size_t offset, size_t count = -1)
+	ks_basic_mutable_string(ks_basic_xmutable_string_base<ELEM, ALLOC>&& other, size_t offset, size_t count = -1)
 		: __my_string_base(other.do_detach().do_substr(offset, count)) { ASSERT(other.is_detached_empty()); this->do_ensure_end_ch0(true); }
 
+	//explicit copy & move ctor (from another ALLOC policy, e.g. ks_local_xxx_string to the shareable one)
+	template <class ALLOC2, class _ = std::enable_if_t<!std::is_same_v<ALLOC2, ALLOC>>>
+	explicit ks_basic_mutable_string(const ks_basic_xmutable_string_base<ELEM, ALLOC2>& other)
+		: __my_string_base(other) { this->do_ensure_end_ch0(true); }
+	template <class ALLOC2, class _ = std::enable_if_t<!std::is_same_v<ALLOC2, ALLOC>>>
+	explicit ks_basic_mutable_string(ks_basic_xmutable_string_base<ELEM, ALLOC2>&& other)
+		: __my_string_base(std::move(other)) { this->do_ensure_end_ch0(true); }
+
 	//copy & move ctor (from std::basic_string)
 	template <class CharTraits, class AllocType>
 	ks_basic_mutable_string(const std::basic_string<ELEM, CharTraits, AllocType>& str)
@@ -78,9 +86,9 @@ public:
 	ks_basic_mutable_string(const std::basic_string<ELEM, CharTraits, AllocType>& str, size_t offset, size_t count = -1)
 		: __my_string_base(__to_basic_string_view(str, offset, count)) { ASSERT(this->do_check_end_ch0()); }
 
-	ks_basic_mutable_string(std::basic_string<ELEM, ks_char_traits<ELEM>, ks_basic_string_allocator<ELEM>>&& str_rvref)
+	ks_basic_mutable_string(std::basic_string<ELEM, ks_char_traits<ELEM>, ALLOC>&& str_rvref)
 		: __my_string_base(std::move(str_rvref)) { ASSERT(this->do_check_end_ch0()); }
-	ks_basic_mutable_string(std::basic_string<ELEM, ks_char_traits<ELEM>, ks_basic_string_allocator<ELEM>>&& str_rvref, size_t offset, size_t count = -1)
+	ks_basic_mutable_string(std::basic_string<ELEM, ks_char_traits<ELEM>, ALLOC>&& str_rvref, size_t offset, size_t count = -1)
 		: __my_string_base(__my_string_base(std::move(str_rvref)).substr(offset, count)) { ASSERT(this->do_check_end_ch0()); }
 
 public:
@@ -111,9 +119,9 @@ public:
 	template <class RIGHT, class _ = std::enable_if_t<std::is_convertible_v<RIGHT, ks_basic_string_view<ELEM>>>>
 	ks_basic_mutable_string& assign(RIGHT&& right) {
 		//if right is a xmutable-string, do assign directly, so this will ref right.data
-		if (std::is_base_of_v<ks_basic_xmutable_string_base<ELEM>, std::remove_cv_t<std::remove_reference_t<RIGHT>>>)
+		if (std::is_base_of_v<ks_basic_xmutable_string_base<ELEM, ALLOC>, std::remove_cv_t<std::remove_reference_t<RIGHT>>>)
 			*this = ks_basic_mutable_string(std::forward<RIGHT>(right));
-		else if (std::is_same_v<RIGHT, std::basic_string<ELEM, ks_char_traits<ELEM>, ks_basic_string_allocator<ELEM>>&&>)
+		else if (std::is_same_v<RIGHT, std::basic_string<ELEM, ks_char_traits<ELEM>, ALLOC>&&>)
 			*this = ks_basic_mutable_string(std::forward<RIGHT>(right));
 		else
 			this->do_assign(__to_basic_string_view(right), true);
@@ -122,9 +130,9 @@ public:
 	template <class RIGHT, class _ = std::enable_if_t<std::is_convertible_v<RIGHT, ks_basic_string_view<ELEM>>>>
 	ks_basic_mutable_string& assign(RIGHT&& right, size_t offset, size_t count = -1) {
 		//if right is a xmutable-string, do assign directly, so this will ref right.data
-		if (std::is_base_of_v<ks_basic_xmutable_string_base<ELEM>, std::remove_cv_t<std::remove_reference_t<RIGHT>>>)
+		if (std::is_base_of_v<ks_basic_xmutable_string_base<ELEM, ALLOC>, std::remove_cv_t<std::remove_reference_t<RIGHT>>>)
 			*this = ks_basic_mutable_string(std::forward<RIGHT>(right), offset, count);
-		else if (std::is_same_v<RIGHT, std::basic_string<ELEM, ks_char_traits<ELEM>, ks_basic_string_allocator<ELEM>>&&>)
+		else if (std::is_same_v<RIGHT, std::basic_string<ELEM, ks_char_traits<ELEM>, ALLOC>&&>)
 			*this = ks_basic_mutable_string(std::forward<RIGHT>(right), offset, count);
 		else
 			this->do_assign(__to_basic_string_view(right, offset, count), true);
@@ -371,6 +379,15 @@ public:
 		this->do_ensure_exclusive(); //for compatibility, ensure exclusive！
 	}
 
+	//resize to count without initializing, and let op(p, count) overwrite the exclusive storage directly, op returns the new length (<= count).
+	//note: the first min(length, count) elements keep the original content, the others are uninitialized.
+	template <class OP>
+	void resize_and_overwrite(size_t count, OP op) {
+		ELEM* p = this->__begin_exclusive_writing(count);
+		const size_t new_length = size_t(std::move(op)(p, count));
+		this->__end_exclusive_writing(p, new_length);
+	}
+
 	//exclusive
 	ELEM* __begin_exclusive_writing(size_t capa) {
 		this->do_resize(capa, ELEM{}, false, false);
@@ -418,29 +435,29 @@ public:
 
 public:
 	//注：for optimization, use immutable-string as return-type
-	std::vector<ks_basic_immutable_string<ELEM>> split(const ks_basic_string_view<ELEM>& sep, size_t n = -1) const {
-		return this->template do_split<ks_basic_immutable_string<ELEM>>(sep, n);
+	std::vector<ks_basic_immutable_string<ELEM, ALLOC>> split(const ks_basic_string_view<ELEM>& sep, size_t n = -1) const {
+		return this->template do_split<ks_basic_immutable_string<ELEM, ALLOC>>(sep, n);
 	}
 
 public:
 	//注：for optimization, use immutable-string as return-type
-	ks_basic_immutable_string<ELEM> slice(size_t from, size_t to = size_t(-1)) const& noexcept { return this->to_immutable().slice(from, to); }
-	ks_basic_immutable_string<ELEM> slice(size_t from, size_t to = size_t(-1))&& noexcept { return this->detach_to_immutable().slice(from, to); }
+	ks_basic_immutable_string<ELEM, ALLOC> slice(size_t from, size_t to = size_t(-1)) const& { return this->to_immutable().slice(from, to); }
+	ks_basic_immutable_string<ELEM, ALLOC> slice(size_t from, size_t to = size_t(-1))&& { return this->detach_to_immutable().slice(from, to); }
 
-	ks_basic_immutable_string<ELEM> substr(size_t offset, size_t count = size_t(-1)) const& { return this->to_immutable().substr(offset, count); }
-	ks_basic_immutable_string<ELEM> substr(size_t offset, size_t count = size_t(-1))&& { return this->detach_to_immutable().substr(offset, count); }
+	ks_basic_immutable_string<ELEM, ALLOC> substr(size_t offset, size_t count = size_t(-1)) const& { return this->to_immutable().substr(offset, count); }
+	ks_basic_immutable_string<ELEM, ALLOC> substr(size_t offset, size_t count = size_t(-1))&& { return this->detach_to_immutable().substr(offset, count); }
 
-	ks_basic_immutable_string<ELEM> slice(const_iterator from, const_iterator to) const& noexcept { size_t from_pos = from - this->cbegin(), to_pos = to - this->cbegin(); return this->to_immutable().slice(from_pos, to_pos); }
-	ks_basic_immutable_string<ELEM> slice(const_iterator from, const_iterator to)&& noexcept { size_t from_pos = from - this->cbegin(), to_pos = to - this->cbegin(); return this->detach_to_immutable().slice(from_pos, to_pos); }
+	ks_basic_immutable_string<ELEM, ALLOC> slice(const_iterator from, const_iterator to) const& { size_t from_pos = from - this->cbegin(), to_pos = to - this->cbegin(); return this->to_immutable().slice(from_pos, to_pos); }
+	ks_basic_immutable_string<ELEM, ALLOC> slice(const_iterator from, const_iterator to)&& { size_t from_pos = from - this->cbegin(), to_pos = to - this->cbegin(); return this->detach_to_immutable().slice(from_pos, to_pos); }
 
-	ks_basic_immutable_string<ELEM> substr(const_iterator from, const_iterator to) const& { size_t offset = from - this->cbegin(), count = to - from; return this->to_immutable().substr(offset, count); }
-	ks_basic_immutable_string<ELEM> substr(const_iterator from, const_iterator to)&& { size_t offset = from - this->cbegin(), count = to - from; return this->detach_to_immutable().substr(offset, count); }
+	ks_basic_immutable_string<ELEM, ALLOC> substr(const_iterator from, const_iterator to) const& { size_t offset = from - this->cbegin(), count = to - from; return this->to_immutable().substr(offset, count); }
+	ks_basic_immutable_string<ELEM, ALLOC> substr(const_iterator from, const_iterator to)&& { size_t offset = from - this->cbegin(), count = to - from; return this->detach_to_immutable().substr(offset, count); }
 
-	ks_basic_immutable_string<ELEM> trimmed() const& { return this->to_immutable().trimmed(); }
-	ks_basic_immutable_string<ELEM> trimmed()&& { return this->detach_to_immutable().trimmed(); }
+	ks_basic_immutable_string<ELEM, ALLOC> trimmed() const& { return this->to_immutable().trimmed(); }
+	ks_basic_immutable_string<ELEM, ALLOC> trimmed()&& { return this->detach_to_immutable().trimmed(); }
 
-	ks_basic_immutable_string<ELEM> shrunk() const& { return this->to_immutable().shrunk(); }
-	ks_basic_immutable_string<ELEM> shrunk()&& { return this->detach_to_immutable().shrunk(); }
+	ks_basic_immutable_string<ELEM, ALLOC> shrunk() const& { return this->to_immutable().shrunk(); }
+	ks_basic_immutable_string<ELEM, ALLOC> shrunk()&& { return this->detach_to_immutable().shrunk(); }
 
 	const ELEM* c_str() const noexcept {
 		ASSERT(this->do_check_end_ch0());
@@ -448,11 +465,11 @@ public:
 	}
 
 public:
-	ks_basic_immutable_string<ELEM> to_immutable() const& noexcept { return ks_basic_immutable_string<ELEM>(*this); }
-	ks_basic_immutable_string<ELEM> to_immutable()&& noexcept { return ks_basic_immutable_string<ELEM>(this->detach()); }
+	ks_basic_immutable_string<ELEM, ALLOC> to_immutable() const& noexcept { return ks_basic_immutable_string<ELEM, ALLOC>(*this); }
+	ks_basic_immutable_string<ELEM, ALLOC> to_immutable()&& noexcept { return ks_basic_immutable_string<ELEM, ALLOC>(this->detach()); }
 
 	ks_basic_mutable_string detach() noexcept { return ks_basic_mutable_string(std::move(*this)); }
-	ks_basic_immutable_string<ELEM> detach_to_immutable() noexcept { return ks_basic_immutable_string<ELEM>(this->detach()); }
+	ks_basic_immutable_string<ELEM, ALLOC> detach_to_immutable() noexcept { return ks_basic_immutable_string<ELEM, ALLOC>(this->detach()); }
 
 public:
 	template <class RIGHT, class _ = std::enable_if_t<std::is_convertible_v<RIGHT, ks_basic_string_view<ELEM>>>>
@@ -462,49 +479,49 @@ public:
 	}
 
 	template <class RIGHT, class _ = std::enable_if_t<std::is_convertible_v<RIGHT, ks_basic_string_view<ELEM>>>>
-	ks_basic_immutable_string<ELEM> operator+(RIGHT&& right) const& {
+	ks_basic_immutable_string<ELEM, ALLOC> operator+(RIGHT&& right) const& {
 		return this->to_immutable() + right;
 	}
 
 	template <class RIGHT, class _ = std::enable_if_t<std::is_convertible_v<RIGHT, ks_basic_string_view<ELEM>>>>
-	ks_basic_immutable_string<ELEM> operator+(RIGHT&& right)&& {
+	ks_basic_immutable_string<ELEM, ALLOC> operator+(RIGHT&& right)&& {
 		return this->detach_to_immutable() + right;
 	}
 };
 
 
-template <class ELEM, class LEFT, class _ = std::enable_if_t<std::is_convertible_v<LEFT, ks_basic_string_view<ELEM>>>>
-inline ks_basic_immutable_string<ELEM> operator+(const LEFT& left, const ks_basic_mutable_string<ELEM>& right) {
+template <class ELEM, class ALLOC, class LEFT, class _ = std::enable_if_t<std::is_convertible_v<LEFT, ks_basic_string_view<ELEM>>>>
+inline ks_basic_immutable_string<ELEM, ALLOC> operator+(const LEFT& left, const ks_basic_mutable_string<ELEM, ALLOC>& right) {
 	return left + right.to_immutable();
 }
 
-template <class ELEM, class LEFT, class _ = std::enable_if_t<std::is_convertible_v<LEFT, ks_basic_string_view<ELEM>>>>
-inline ks_basic_immutable_string<ELEM> operator+(const LEFT& left, ks_basic_mutable_string<ELEM>&& right) {
+template <class ELEM, class ALLOC, class LEFT, class _ = std::enable_if_t<std::is_convertible_v<LEFT, ks_basic_string_view<ELEM>>>>
+inline ks_basic_immutable_string<ELEM, ALLOC> operator+(const LEFT& left, ks_basic_mutable_string<ELEM, ALLOC>&& right) {
 	return left + right.detach_to_immutable();
 }
 
 
 namespace std {
-	template <class ELEM>
-	inline void swap(ks_basic_mutable_string<ELEM>& l, ks_basic_mutable_string<ELEM>& r) noexcept {
+	template <class ELEM, class ALLOC>
+	inline void swap(ks_basic_mutable_string<ELEM, ALLOC>& l, ks_basic_mutable_string<ELEM, ALLOC>& r) noexcept {
 		l.swap(r);
 	}
 
-	template <class ELEM>
-	struct hash<ks_basic_mutable_string<ELEM>> : hash<ks_basic_xmutable_string_base<ELEM>> {
+	template <class ELEM, class ALLOC>
+	struct hash<ks_basic_mutable_string<ELEM, ALLOC>> : hash<ks_basic_xmutable_string_base<ELEM, ALLOC>> {
 	};
 }
 
 
-template <class ELEM>
-inline std::basic_ostream<ELEM, std::char_traits<ELEM>>& operator<<(std::basic_ostream<ELEM, std::char_traits<ELEM>>& strm, const ks_basic_mutable_string<ELEM>& str) {
+template <class ELEM, class ALLOC>
+inline std::basic_ostream<ELEM, std::char_traits<ELEM>>& operator<<(std::basic_ostream<ELEM, std::char_traits<ELEM>>& strm, const ks_basic_mutable_string<ELEM, ALLOC>& str) {
 	return strm << str.view();
 }
 
-template <class ELEM>
-inline std::basic_istream<ELEM, std::char_traits<ELEM>>& operator>>(std::basic_istream<ELEM, std::char_traits<ELEM>>& strm, ks_basic_mutable_string<ELEM>& str) {
-	std::basic_string<ELEM, std::char_traits<ELEM>, ks_basic_string_allocator<ELEM>> std_str;
+template <class ELEM, class ALLOC>
+inline std::basic_istream<ELEM, std::char_traits<ELEM>>& operator>>(std::basic_istream<ELEM, std::char_traits<ELEM>>& strm, ks_basic_mutable_string<ELEM, ALLOC>& str) {
+	std::basic_string<ELEM, std::char_traits<ELEM>, ALLOC> std_str;
 	strm >> std_str;
-	str = ks_basic_mutable_string<ELEM>(std::move(std_str));
+	str = ks_basic_mutable_string<ELEM, ALLOC>(std::move(std_str));
 	return strm;
 }
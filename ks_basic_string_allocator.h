@@ -17,9 +17,94 @@ limitations under the License.
 
 #include <memory>
 #include <atomic>
+#include <new>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include "ks_basic_string_view.h"
+#include "ks_string_memory_pool.h"
+#include "ks_string_memory_huge.h"
+#include "ks_string_memory_arena.h"
+#include "ks_string_memory_stats.h"
+#include "ks_string_memory_tag.h"
+#include "ks_string_biased_refcount.h"
+#include "ks_string_immortal_policy.h"
 
 
-template <class ELEM>
+//the default raw memory of string buffers: the slab pool (if MODERN_STRING_POOL_ENABLED) for small ones,
+//anonymous mmap (if MODERN_STRING_HUGE_THRESHOLD) for huge ones, and malloc for others.
+//a custom raw memory type (e.g. numa-aware heap) should provide the same static allocate (returns 16-aligned memory) and deallocate methods,
+//and then be used as ks_basic_string_allocator<ELEM, MEMORY>, which is the ALLOC param of string types.
+//the reallocate method is optional, which keeps the content and leaves the grown part uninitialized.
+class MODERN_STRING_INLINE_API ks_string_default_memory {
+public:
+    static void* allocate(size_t size) {
+#ifdef MODERN_STRING_POOL_ENABLED
+        if (ks_string_memory_pool::is_pooled_size(size))
+            return ks_string_memory_pool::allocate(size);
+#endif
+        if (ks_string_memory_huge::is_huge_size(size))
+            return ks_string_memory_huge::allocate(size);
+        void* p = malloc(size);
+        if (p == nullptr)
+            throw std::bad_alloc();
+        return p;
+    }
+
+    static void deallocate(void* p, size_t size) noexcept {
+#ifdef MODERN_STRING_POOL_ENABLED
+        if (ks_string_memory_pool::is_pooled_size(size))
+            return ks_string_memory_pool::deallocate(p, size);
+#endif
+        if (ks_string_memory_huge::is_huge_size(size))
+            return ks_string_memory_huge::deallocate(p, size);
+        free(p);
+    }
+
+    static void* reallocate(void* p, size_t old_size, size_t new_size) {
+        if (__is_mapped_size(old_size) && __is_mapped_size(new_size))
+            return ks_string_memory_huge::reallocate(p, old_size, new_size);
+
+        if (__is_malloc_size(old_size) && __is_malloc_size(new_size)) {
+            //realloc may grow the block in place (and glibc moves large blocks by mremap)
+            void* new_p = realloc(p, new_size);
+            if (new_p == nullptr)
+                throw std::bad_alloc();
+            return new_p;
+        }
+
+        void* new_p = allocate(new_size);
+        memcpy(new_p, p, std::min(old_size, new_size));
+        deallocate(p, old_size);
+        return new_p;
+    }
+
+private:
+    static constexpr bool __is_malloc_size(size_t size) noexcept {
+#ifdef MODERN_STRING_POOL_ENABLED
+        if (ks_string_memory_pool::is_pooled_size(size))
+            return false;
+#endif
+        return !ks_string_memory_huge::is_huge_size(size);
+    }
+
+    //dispatched as allocate and deallocate do, the pool goes first (the huge threshold may be under MAX_POOLED_SIZE)
+    static constexpr bool __is_mapped_size(size_t size) noexcept {
+#ifdef MODERN_STRING_POOL_ENABLED
+        if (ks_string_memory_pool::is_pooled_size(size))
+            return false;
+#endif
+        return ks_string_memory_huge::is_huge_size(size);
+    }
+};
+
+
+//the allocator of string buffers, every buffer is prefixed with a 16 bytes header: bias32 (at p-16), flags32 (at p-12), refcount32 (at p-8) and space32 (at p-4).
+//the low 16 bits of flags32 are flags, and the high 16 bits are the allocation tag (see also ks_string_memory_tag).
+//the bias32 is the owner token and biased count if MODERN_STRING_BIASED_REFCOUNT_ENABLED (see also ks_string_biased_refcount), or else 0.
+//the data is aligned to ks_basic_string_buffer_traits::HEAP_ALIGNMENT, and the space is padded to it, and space32 counts in heap-alignment granules (so a buffer is 64GB at most).
+//note: the ALLOC param of string types must follow this header contract, and provide the _refcountful_xxx methods.
+template <class ELEM, class MEMORY = ks_string_default_memory>
 class MODERN_STRING_INLINE_API ks_basic_string_allocator {
 public:
     using size_type = size_t;
@@ -29,32 +114,40 @@ public:
     using const_reference = const ELEM&;
     using pointer = ELEM*;
     using const_pointer = const ELEM*;
+    using memory_type = MEMORY;
+
+    static constexpr size_t SSO_FIX_SIZE = 0; //the inline footprint of the string types, 0 means the default one (see also ks_basic_string_sso_allocator)
+    static constexpr bool WIDE_LAYOUT = false; //whether the string types use 64-bit offset and length (see also ks_basic_string_wide_allocator)
+    static constexpr size_t SSO_ALIGNMENT = 0; //the alignment of the sso union, 0 means the natural one (see also ks_basic_string_aligned_allocator)
 
     constexpr ks_basic_string_allocator() noexcept {}
     constexpr ks_basic_string_allocator(const ks_basic_string_allocator&) noexcept {}
 
     template <class ELEM2> 
-    constexpr ks_basic_string_allocator(const ks_basic_string_allocator<ELEM2>&) noexcept {}
+    constexpr ks_basic_string_allocator(const ks_basic_string_allocator<ELEM2, MEMORY>&) noexcept {}
 
     template <class ELEM2>
-    struct rebind { using other = ks_basic_string_allocator<ELEM2>; };
+    struct rebind { using other = ks_basic_string_allocator<ELEM2, MEMORY>; };
 
     static ELEM* address(ELEM& _Val) noexcept { return std::addressof(_Val); }
     static const ELEM* address(const ELEM& _Val) noexcept { return std::addressof(_Val); }
 
     static ELEM* allocate(size_t _Count) {
-        if (_Count > 0x7FFFFFFFu)
+        if (_Count > _MAX_SPACE_COUNT)
             throw std::bad_array_new_length();
-        _Count = ((_Count * sizeof(ELEM) + 3) & ~size_t(0x03)) / sizeof(ELEM);
-        size_t alloc_size = __header_size() + ((_Count * sizeof(ELEM) + 3) & ~size_t(0x03));
-        ASSERT(alloc_size % 4 == 0);
-        uintptr_t addr = (uintptr_t)malloc(alloc_size);
-        if (addr == 0)
-            throw std::bad_alloc();
-        ASSERT(addr % 4 == 0);
+        _Count = __padded_count(_Count);
+        size_t alloc_size = __header_size() + _Count * sizeof(ELEM);
+        ASSERT(alloc_size % _HEAP_ALIGNMENT == 0);
+        uintptr_t addr = (uintptr_t)MEMORY::allocate(alloc_size);
+        ASSERT(addr % _HEAP_ALIGNMENT == 0);
+#ifdef MODERN_STRING_STATS_ENABLED
+        ks_string_memory_stats::__record_alloc(alloc_size);
+#endif
         addr += __header_size();
-        *(uint32_t*)__get_space32_p((ELEM*)(addr)) = uint32_t(_Count);
+        *(uint32_t*)__get_space32_p((ELEM*)(addr)) = uint32_t(_Count * sizeof(ELEM) / _HEAP_ALIGNMENT);
         *(uint32_t*)__get_refcount32_p((ELEM*)(addr)) = 0;
+        *(uint32_t*)__get_flags32_p((ELEM*)(addr)) = 0;
+        *(uint32_t*)__get_bias32_p((ELEM*)(addr)) = 0;
         return (ELEM*)(addr);
     }
 
@@ -65,12 +158,19 @@ public:
     static void deallocate(ELEM* _Ptr) noexcept {
         ASSERT(_Ptr != nullptr);
         ASSERT(*(uint32_t*)__get_refcount32_p(_Ptr) == 0);
-        free((void*)(uintptr_t(_Ptr) - __header_size()));
+        const size_t alloc_size = __header_size() + _get_space_value(_Ptr) * sizeof(ELEM);
+#ifdef MODERN_STRING_STATS_ENABLED
+        ks_string_memory_stats::__record_free(alloc_size);
+#endif
+        const uint16_t tag = _get_tag_value(_Ptr);
+        if (tag != 0)
+            ks_string_memory_tag::__record_free(tag, alloc_size);
+        MEMORY::deallocate((void*)(uintptr_t(_Ptr) - __header_size()), alloc_size);
     }
 
     static void deallocate(ELEM* _Ptr, size_t _Count) noexcept {
         ASSERT(_Ptr != nullptr);
-        ASSERT(_get_space32_value(_Ptr) == ((_Count * sizeof(ELEM) + 3) & ~size_t(0x03)) / sizeof(ELEM));
+        ASSERT(_get_space_value(_Ptr) == __padded_count(_Count));
         deallocate(_Ptr);
     }
 
@@ -89,13 +189,13 @@ public:
     }
 
     template <class _Uty> 
-    bool operator ==(const ks_basic_string_allocator<_Uty>&) const { return true; }
+    bool operator ==(const ks_basic_string_allocator<_Uty, MEMORY>&) const { return true; }
     template <class _Uty> 
-    bool operator !=(const ks_basic_string_allocator<_Uty>&) const { return false; }
+    bool operator !=(const ks_basic_string_allocator<_Uty, MEMORY>&) const { return false; }
 
 public:
     static ELEM* _refcountful_alloc(size_t _Count) {
-        ELEM* _Ptr = allocate(_Count);
+        ELEM* _Ptr = __refcountful_alloc_unref(_Count);
         _refcountful_initref(_Ptr);
         return _Ptr;
     }
@@ -103,37 +203,316 @@ public:
     static void _refcountful_initref(ELEM* _Ptr) noexcept {
         ASSERT(_Ptr != nullptr);
         ASSERT(_peek_refcount32_value(_Ptr) == 0);
-        (*(std::atomic<uint32_t>*)__get_refcount32_p(_Ptr)).store(1, std::memory_order_relaxed);
+        auto* refcount32_p = (std::atomic<uint32_t>*)__get_refcount32_p(_Ptr);
+        const uint32_t refcount32 = refcount32_p->load(std::memory_order_relaxed);
+#ifdef MODERN_STRING_BIASED_REFCOUNT_ENABLED
+        if (refcount32 == 0) { //not arena buffer
+            const uint32_t token = ks_string_biased_refcount::__acquire_token();
+            if (token != 0) {
+                ((std::atomic<uint32_t>*)__get_bias32_p(_Ptr))->store(token | (1u << _BIAS_SHIFT), std::memory_order_relaxed);
+                refcount32_p->store(ks_string_biased_refcount::SHARED_OFFSET, std::memory_order_relaxed);
+                return;
+            }
+        }
+#endif
+        refcount32_p->store(refcount32 + 1, std::memory_order_relaxed); //the arena bias is kept
     }
 
     static void _refcountful_addref(ELEM* _Ptr) noexcept {
+        _refcountful_addref_n(_Ptr, 1);
+    }
+
+    //add n refs at once (for the slices made in batch, e.g. split), by one atomic RMW at most
+    static void _refcountful_addref_n(ELEM* _Ptr, size_t n) noexcept {
         ASSERT(_Ptr != nullptr);
         ASSERT(_peek_refcount32_value(_Ptr) >= 1);
-        (void)(*(std::atomic<uint32_t>*)__get_refcount32_p(_Ptr)).fetch_add(1, std::memory_order_relaxed);
+        ASSERT(n != 0 && n <= _SHARED_REFCOUNT_MASK);
+        if (_refcountful_is_immortal(_Ptr))
+            return;
+#ifdef MODERN_STRING_BIASED_REFCOUNT_ENABLED
+        auto* bias32_p = (std::atomic<uint32_t>*)__get_bias32_p(_Ptr);
+        const uint32_t bias32 = bias32_p->load(std::memory_order_relaxed);
+        const uint32_t token = bias32 & ks_string_biased_refcount::MAX_TOKEN;
+        if (token != 0 && token == ks_string_biased_refcount::current_token() && (bias32 >> _BIAS_SHIFT) + n <= ks_string_biased_refcount::MAX_BIASED_COUNT) {
+            bias32_p->store(bias32 + (uint32_t(n) << _BIAS_SHIFT), std::memory_order_relaxed); //by owner, non-atomic
+            return;
+        }
+#endif
+        const uint32_t old_value = (*(std::atomic<uint32_t>*)__get_refcount32_p(_Ptr)).fetch_add(uint32_t(n), std::memory_order_relaxed);
+        const uint32_t old_count = old_value & _SHARED_REFCOUNT_MASK;
+        const uint32_t new_count = (old_value + uint32_t(n)) & _SHARED_REFCOUNT_MASK;
+        if ((old_count ^ new_count) > old_count) //crossed a power of 2
+            __try_promote_immortal(_Ptr, new_count);
     }
 
     static void _refcountful_release(ELEM* _Ptr) noexcept {
         ASSERT(_Ptr != nullptr);
         ASSERT(_peek_refcount32_value(_Ptr) >= 1);
-        uint32_t new_value = (*(std::atomic<uint32_t>*)__get_refcount32_p(_Ptr)).fetch_sub(1, std::memory_order_release) - 1;
+        if (_refcountful_is_immortal(_Ptr))
+            return;
+#ifdef MODERN_STRING_BIASED_REFCOUNT_ENABLED
+        const uint32_t bias32 = ((std::atomic<uint32_t>*)__get_bias32_p(_Ptr))->load(std::memory_order_relaxed);
+        if ((bias32 & ks_string_biased_refcount::MAX_TOKEN) != 0 && __biased_release(_Ptr, bias32))
+            return;
+#endif
+        auto* refcount32_p = (std::atomic<uint32_t>*)__get_refcount32_p(_Ptr);
+        if (refcount32_p->load(std::memory_order_relaxed) == 2)
+            __mark_compact_candidate(_Ptr); //before the decrement, the survivor may free it at once
+        uint32_t new_value = refcount32_p->fetch_sub(1, std::memory_order_release) - 1;
         if (new_value == 0) {
             std::atomic_thread_fence(std::memory_order_acquire);
             deallocate(_Ptr);
         }
     }
 
-    static constexpr uint32_t _get_space32_value(ELEM* p) noexcept {
-        return *(uint32_t*)__get_space32_p(p);
+    //rewrite the refcount of an exclusive buffer in the plain form, before it's adopted by another ALLOC policy
+    static void _refcountful_unbias(ELEM* _Ptr) noexcept {
+        ASSERT(_Ptr != nullptr);
+        ASSERT(_peek_refcount32_value(_Ptr, true) == 1);
+#ifdef MODERN_STRING_BIASED_REFCOUNT_ENABLED
+        auto* bias32_p = (std::atomic<uint32_t>*)__get_bias32_p(_Ptr);
+        if (bias32_p->load(std::memory_order_relaxed) != 0) {
+            bias32_p->store(0, std::memory_order_relaxed);
+            ((std::atomic<uint32_t>*)__get_refcount32_p(_Ptr))->store(1, std::memory_order_relaxed);
+        }
+#endif
+    }
+
+protected:
+    static ELEM* __refcountful_alloc_unref(size_t _Count) {
+        ks_string_memory_arena* arena = ks_string_memory_arena::current();
+        ELEM* _Ptr;
+        if (arena != nullptr && __header_size() == _HEAP_ALIGNMENT) {
+            _Ptr = __arena_allocate(arena, _Count);
+        }
+        else {
+            _Ptr = allocate(_Count);
+            const uint16_t tag = ks_string_memory_tag::current();
+            if (tag != 0) {
+                *(uint32_t*)__get_flags32_p(_Ptr) = uint32_t(tag) << _TAG_SHIFT;
+                ks_string_memory_tag::__record_alloc(tag, __header_size() + _get_space_value(_Ptr) * sizeof(ELEM));
+            }
+        }
+        return _Ptr;
+    }
+
+public:
+    static bool _refcountful_is_compact_candidate(ELEM* _Ptr) noexcept {
+        return (((std::atomic<uint32_t>*)__get_flags32_p(_Ptr))->load(std::memory_order_relaxed) & _FLAG_COMPACT_CANDIDATE) != 0;
+    }
+
+    static void _refcountful_clear_compact_candidate(ELEM* _Ptr) noexcept {
+        ((std::atomic<uint32_t>*)__get_flags32_p(_Ptr))->fetch_and(~_FLAG_COMPACT_CANDIDATE, std::memory_order_relaxed);
+    }
+
+    //the last owner survives, it may be compacted later (see also ks_string_slice_policy)
+    static void __mark_compact_candidate(ELEM* _Ptr) noexcept {
+        ((std::atomic<uint32_t>*)__get_flags32_p(_Ptr))->fetch_or(_FLAG_COMPACT_CANDIDATE, std::memory_order_relaxed);
+    }
+
+    static bool _refcountful_is_arena(ELEM* _Ptr) noexcept {
+        return (((std::atomic<uint32_t>*)__get_refcount32_p(_Ptr))->load(std::memory_order_relaxed) & ks_string_memory_arena::REFCOUNT_BIAS) != 0;
+    }
+
+    static bool _refcountful_is_immortal(ELEM* _Ptr) noexcept {
+        return (((std::atomic<uint32_t>*)__get_flags32_p(_Ptr))->load(std::memory_order_relaxed) & _FLAG_IMMORTAL) != 0;
+    }
+
+    //freeze the refcount of the buffer, then addref and release are no-ops, and the buffer is never freed (see also ks_string_immortal_policy).
+    //it's safe while the caller holds a reference, the releases which miss the flag never drop the refcount to 0.
+    //returns false for arena buffers, which are released by arena.
+    static bool _refcountful_make_immortal(ELEM* _Ptr) noexcept {
+        ASSERT(_Ptr != nullptr);
+        if ((((std::atomic<uint32_t>*)__get_refcount32_p(_Ptr))->load(std::memory_order_relaxed) & ks_string_memory_arena::REFCOUNT_BIAS) != 0)
+            return false;
+        ((std::atomic<uint32_t>*)__get_flags32_p(_Ptr))->fetch_or(_FLAG_IMMORTAL, std::memory_order_relaxed);
+        return true;
+    }
+
+    //promote the buffer automatically if its refcount reaches the threshold, and the total promoted bytes are under the cap (see also ks_string_immortal_policy)
+    static _NO_INLINE void __try_promote_immortal(ELEM* _Ptr, uint32_t refcount) noexcept {
+        const size_t promote_refcount = ks_string_immortal_policy::promote_refcount();
+        if (promote_refcount == 0 || refcount < promote_refcount)
+            return;
+        if ((((std::atomic<uint32_t>*)__get_refcount32_p(_Ptr))->load(std::memory_order_relaxed) & ks_string_memory_arena::REFCOUNT_BIAS) != 0)
+            return;
+
+        const size_t alloc_size = __header_size() + _get_space_value(_Ptr) * sizeof(ELEM);
+        if (!ks_string_immortal_policy::__reserve_promoted_bytes(alloc_size))
+            return;
+        const uint32_t old_flags32 = ((std::atomic<uint32_t>*)__get_flags32_p(_Ptr))->fetch_or(_FLAG_IMMORTAL, std::memory_order_relaxed);
+        if ((old_flags32 & _FLAG_IMMORTAL) != 0)
+            ks_string_immortal_policy::__unreserve_promoted_bytes(alloc_size); //promoted already
+    }
+
+    //grow the exclusive buffer to hold _Count elements at least, the content is kept and the grown part is uninitialized.
+    //returns nullptr if it can't be regrown (arena buffer, or MEMORY provides no reallocate), then a new buffer should be allocated.
+    static ELEM* _refcountful_regrow(ELEM* _Ptr, size_t _Count) {
+        ASSERT(_Ptr != nullptr);
+        ASSERT(_peek_refcount32_value(_Ptr) == 1);
+        if ((*(uint32_t*)__get_refcount32_p(_Ptr) & ks_string_memory_arena::REFCOUNT_BIAS) != 0)
+            return nullptr; //the arena buffers are released by arena
+        return __reallocate(_Ptr, _Count, true, decltype(__has_reallocate<MEMORY>(0))());
+    }
+
+    //shrink the exclusive buffer to hold _Count elements, the content in range is kept.
+    //returns nullptr if it can't be shrunk (arena buffer, or MEMORY provides no reallocate), then a new buffer should be allocated.
+    static ELEM* _refcountful_shrink(ELEM* _Ptr, size_t _Count) {
+        ASSERT(_Ptr != nullptr);
+        ASSERT(_peek_refcount32_value(_Ptr) == 1);
+        if ((*(uint32_t*)__get_refcount32_p(_Ptr) & ks_string_memory_arena::REFCOUNT_BIAS) != 0)
+            return nullptr; //the arena buffers are released by arena
+        return __reallocate(_Ptr, _Count, false, decltype(__has_reallocate<MEMORY>(0))());
+    }
+
+    static constexpr size_t _get_space_value(ELEM* p) noexcept {
+        return size_t(*(uint32_t*)__get_space32_p(p)) * _HEAP_ALIGNMENT / sizeof(ELEM);
+    }
+
+    static uint16_t _get_tag_value(ELEM* p) noexcept {
+        return uint16_t(((std::atomic<uint32_t>*)__get_flags32_p(p))->load(std::memory_order_relaxed) >> _TAG_SHIFT);
     }
 
     static constexpr uint32_t _peek_refcount32_value(ELEM* p, bool with_acquire_order = false) noexcept {
-        return (*(std::atomic<uint32_t>*)__get_refcount32_p(p)).load(with_acquire_order ? std::memory_order_acquire : std::memory_order_relaxed);
+        if (_refcountful_is_immortal(p))
+            return _IMMORTAL_REFCOUNT; //never exclusive
+#ifdef MODERN_STRING_BIASED_REFCOUNT_ENABLED
+        const uint32_t refcount32 = (*(std::atomic<uint32_t>*)__get_refcount32_p(p)).load(with_acquire_order ? std::memory_order_acquire : std::memory_order_relaxed) & ~ks_string_memory_arena::REFCOUNT_BIAS;
+        if (refcount32 < ks_string_biased_refcount::SHARED_OFFSET)
+            return refcount32; //unbiased, or merged
+        const uint32_t bias32 = (*(std::atomic<uint32_t>*)__get_bias32_p(p)).load(std::memory_order_relaxed);
+        return (refcount32 - ks_string_biased_refcount::SHARED_OFFSET) + ((bias32 & ks_string_biased_refcount::MAX_TOKEN) != 0 ? (bias32 >> _BIAS_SHIFT) : 2); //2 if merging, not exclusive anyway
+#else
+        return (*(std::atomic<uint32_t>*)__get_refcount32_p(p)).load(with_acquire_order ? std::memory_order_acquire : std::memory_order_relaxed) & ~ks_string_memory_arena::REFCOUNT_BIAS;
+#endif
     }
 
-private:
+protected:
+    template <class MEMORY2>
+    static auto __has_reallocate(int) -> decltype(MEMORY2::reallocate(nullptr, size_t(0), size_t(0)), std::true_type());
+    template <class MEMORY2>
+    static std::false_type __has_reallocate(...);
+
+    static ELEM* __reallocate(ELEM* _Ptr, size_t _Count, bool is_growing, std::false_type) noexcept {
+        return nullptr;
+    }
+
+    static ELEM* __reallocate(ELEM* _Ptr, size_t _Count, bool is_growing, std::true_type) {
+        if (_Count > _MAX_SPACE_COUNT)
+            throw std::bad_array_new_length();
+        _Count = __padded_count(_Count);
+        if (is_growing ? _Count <= _get_space_value(_Ptr) : _Count >= _get_space_value(_Ptr))
+            return _Ptr;
+
+        const size_t old_alloc_size = __header_size() + _get_space_value(_Ptr) * sizeof(ELEM);
+        const size_t new_alloc_size = __header_size() + _Count * sizeof(ELEM);
+        uintptr_t addr = (uintptr_t)MEMORY::reallocate((void*)(uintptr_t(_Ptr) - __header_size()), old_alloc_size, new_alloc_size);
+        ASSERT(addr % _HEAP_ALIGNMENT == 0);
+#ifdef MODERN_STRING_STATS_ENABLED
+        ks_string_memory_stats::__record_free(old_alloc_size);
+        ks_string_memory_stats::__record_alloc(new_alloc_size);
+#endif
+        addr += __header_size();
+        const uint16_t tag = _get_tag_value((ELEM*)(addr)); //the header is moved along
+        if (tag != 0) {
+            ks_string_memory_tag::__record_free(tag, old_alloc_size);
+            ks_string_memory_tag::__record_alloc(tag, new_alloc_size);
+        }
+        *(uint32_t*)__get_space32_p((ELEM*)(addr)) = uint32_t(_Count * sizeof(ELEM) / _HEAP_ALIGNMENT);
+        return (ELEM*)(addr);
+    }
+
+#ifdef MODERN_STRING_BIASED_REFCOUNT_ENABLED
+    //the release of biased buffer, returns false if it has been merged (then released in plain atomic way)
+    static bool __biased_release(ELEM* _Ptr, uint32_t bias32) noexcept {
+        auto* bias32_p = (std::atomic<uint32_t>*)__get_bias32_p(_Ptr);
+        auto* refcount32_p = (std::atomic<uint32_t>*)__get_refcount32_p(_Ptr);
+        const uint32_t token = bias32 & ks_string_biased_refcount::MAX_TOKEN;
+        if (token == ks_string_biased_refcount::current_token()) {
+            //by owner, non-atomic, and merge the counts when the biased count drops to 0
+            if ((bias32 >> _BIAS_SHIFT) > 1) {
+                if ((bias32 >> _BIAS_SHIFT) == 2 && refcount32_p->load(std::memory_order_relaxed) == ks_string_biased_refcount::SHARED_OFFSET)
+                    __mark_compact_candidate(_Ptr); //the owner keeps the last one
+                bias32_p->store(bias32 - (1u << _BIAS_SHIFT), std::memory_order_relaxed);
+                return true;
+            }
+
+            bias32_p->store(0, std::memory_order_relaxed);
+            if (refcount32_p->load(std::memory_order_relaxed) == ks_string_biased_refcount::SHARED_OFFSET + 1)
+                __mark_compact_candidate(_Ptr);
+            const uint32_t old_value = refcount32_p->fetch_sub(ks_string_biased_refcount::SHARED_OFFSET, std::memory_order_acq_rel);
+            if (old_value == ks_string_biased_refcount::SHARED_OFFSET)
+                deallocate(_Ptr);
+            return true;
+        }
+
+        //by other threads, the shared count never drops below 0 (the offset) until merged
+        uint32_t refcount32 = refcount32_p->load(std::memory_order_relaxed);
+        for (;;) {
+            if (refcount32 < ks_string_biased_refcount::SHARED_OFFSET)
+                return false; //merged
+            if (refcount32 == ks_string_biased_refcount::SHARED_OFFSET) {
+                __biased_release_slow(_Ptr);
+                return true;
+            }
+            if (refcount32 == ks_string_biased_refcount::SHARED_OFFSET + 1 && (bias32_p->load(std::memory_order_relaxed) >> _BIAS_SHIFT) == 1)
+                __mark_compact_candidate(_Ptr); //the owner keeps the last one, mark it before the decrement
+            if (refcount32_p->compare_exchange_weak(refcount32, refcount32 - 1, std::memory_order_release, std::memory_order_relaxed))
+                return true;
+        }
+    }
+
+    static _NO_INLINE void __biased_release_slow(ELEM* _Ptr) noexcept {
+        auto* bias32_p = (std::atomic<uint32_t>*)__get_bias32_p(_Ptr);
+        uint32_t bias32 = bias32_p->load(std::memory_order_acquire);
+        const uint32_t token = bias32 & ks_string_biased_refcount::MAX_TOKEN;
+        if (token != 0) {
+            if (ks_string_biased_refcount::__enqueue_release(token, _Ptr, &__owner_release))
+                return;
+
+            //the owner has exited, merge its biased count here (by one thread only)
+            if (bias32_p->compare_exchange_strong(bias32, 0, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                const uint32_t biased_count = bias32 >> _BIAS_SHIFT;
+                ((std::atomic<uint32_t>*)__get_refcount32_p(_Ptr))->fetch_add(biased_count - ks_string_biased_refcount::SHARED_OFFSET, std::memory_order_acq_rel);
+            }
+        }
+        _refcountful_release(_Ptr); //again, it's merged (or merging) now
+    }
+
+    static void __owner_release(void* p) noexcept {
+        _refcountful_release((ELEM*)p);
+    }
+#endif
+
+    static ELEM* __arena_allocate(ks_string_memory_arena* arena, size_t _Count) {
+        if (_Count > _MAX_SPACE_COUNT)
+            throw std::bad_array_new_length();
+        _Count = __padded_count(_Count);
+        size_t alloc_size = __header_size() + _Count * sizeof(ELEM);
+        uintptr_t addr = (uintptr_t)arena->allocate(alloc_size);
+        ASSERT(addr % _HEAP_ALIGNMENT == 0);
+        addr += __header_size();
+        ASSERT(uintptr_t(__get_refcount32_p((ELEM*)(addr))) == addr - __header_size() + ks_string_memory_arena::REFCOUNT_OFFSET);
+        *(uint32_t*)__get_space32_p((ELEM*)(addr)) = uint32_t(_Count * sizeof(ELEM) / _HEAP_ALIGNMENT);
+        *(uint32_t*)__get_refcount32_p((ELEM*)(addr)) = ks_string_memory_arena::REFCOUNT_BIAS; //never drops to 0, the arena releases it
+        *(uint32_t*)__get_flags32_p((ELEM*)(addr)) = 0;
+        *(uint32_t*)__get_bias32_p((ELEM*)(addr)) = 0; //never biased
+        return (ELEM*)(addr);
+    }
+
+    static constexpr size_t _HEAP_ALIGNMENT = ks_basic_string_buffer_traits<ELEM>::HEAP_ALIGNMENT;
+    static constexpr size_t _MAX_SPACE_COUNT = sizeof(size_t) >= 8 ? size_t(uint64_t(0xFFFFFFFF) * _HEAP_ALIGNMENT / sizeof(ELEM)) : 0x7FFFFFFF; //the granules of space32
+    static_assert(_HEAP_ALIGNMENT % sizeof(ELEM) == 0 || sizeof(ELEM) % _HEAP_ALIGNMENT == 0, "the space must be whole heap-alignment granules");
+
+    //the header is padded to keep the data aligned, the leading spare bytes are reserved
     static constexpr size_t __header_size() noexcept {
-        static_assert(alignof(ELEM) < 8 ? true : alignof(ELEM) % 4 == 0, "the asign of larger ELEM type must be multi of 4");
-        return alignof(ELEM) < 8 ? 8 : alignof(ELEM);
+        static_assert(alignof(ELEM) <= _HEAP_ALIGNMENT ? true : alignof(ELEM) % _HEAP_ALIGNMENT == 0, "the asign of larger ELEM type must be multi of heap-alignment");
+        return alignof(ELEM) <= _HEAP_ALIGNMENT ? _HEAP_ALIGNMENT : alignof(ELEM);
+    }
+
+    //the space is padded to heap-alignment, so the aligned block containing the end-ch0 is readable
+    static constexpr size_t __padded_count(size_t _Count) noexcept {
+        return ((_Count * sizeof(ELEM) + (_HEAP_ALIGNMENT - 1)) & ~(_HEAP_ALIGNMENT - 1)) / sizeof(ELEM);
     }
 
     static constexpr void* __get_space32_p(ELEM* p) noexcept {
@@ -147,4 +526,144 @@ private:
         ASSERT(uintptr_t(p) % 4 == 0);
         return (void*)(uint32_t*)(uintptr_t(p) - 8);
     }
+
+    static constexpr void* __get_flags32_p(ELEM* p) noexcept {
+        ASSERT(p != nullptr);
+        ASSERT(uintptr_t(p) % 4 == 0);
+        return (void*)(uint32_t*)(uintptr_t(p) - 12);
+    }
+
+    static constexpr void* __get_bias32_p(ELEM* p) noexcept {
+        ASSERT(p != nullptr);
+        ASSERT(uintptr_t(p) % 4 == 0);
+        return (void*)(uint32_t*)(uintptr_t(p) - 16);
+    }
+
+    static constexpr uint32_t _FLAG_COMPACT_CANDIDATE = 0x01;
+    static constexpr uint32_t _FLAG_IMMORTAL = 0x02;
+    static constexpr uint32_t _IMMORTAL_REFCOUNT = 0x1FFFFFFF;
+    static constexpr uint32_t _SHARED_REFCOUNT_MASK = ks_string_biased_refcount::SHARED_OFFSET - 1; //without the arena bias and the biased offset
+    static constexpr uint32_t _TAG_SHIFT = 16;
+    static constexpr uint32_t _BIAS_SHIFT = ks_string_biased_refcount::TOKEN_BITS;
+};
+
+
+//the allocator of thread-confined string buffers, whose refcount is changed by plain (non-atomic) instructions.
+//note: the strings of this allocator (ks_local_xxx_string) must never be shared across threads,
+//convert them to the shareable strings explicitly before (the exclusive buffer is adopted, or else copied).
+template <class ELEM, class MEMORY = ks_string_default_memory>
+class MODERN_STRING_INLINE_API ks_basic_string_local_allocator : public ks_basic_string_allocator<ELEM, MEMORY> {
+    using __my_base = ks_basic_string_allocator<ELEM, MEMORY>;
+
+public:
+    constexpr ks_basic_string_local_allocator() noexcept {}
+    constexpr ks_basic_string_local_allocator(const ks_basic_string_local_allocator&) noexcept {}
+
+    template <class ELEM2>
+    constexpr ks_basic_string_local_allocator(const ks_basic_string_local_allocator<ELEM2, MEMORY>&) noexcept {}
+
+    template <class ELEM2>
+    struct rebind { using other = ks_basic_string_local_allocator<ELEM2, MEMORY>; };
+
+public:
+    static ELEM* _refcountful_alloc(size_t _Count) {
+        ELEM* _Ptr = __my_base::__refcountful_alloc_unref(_Count);
+        _refcountful_initref(_Ptr);
+        return _Ptr;
+    }
+
+    static void _refcountful_initref(ELEM* _Ptr) noexcept {
+        ASSERT(_Ptr != nullptr);
+        ASSERT(__my_base::_peek_refcount32_value(_Ptr) == 0);
+        ++*(uint32_t*)__my_base::__get_refcount32_p(_Ptr); //never biased, and the arena bias is kept
+    }
+
+    static void _refcountful_addref(ELEM* _Ptr) noexcept {
+        _refcountful_addref_n(_Ptr, 1);
+    }
+
+    static void _refcountful_addref_n(ELEM* _Ptr, size_t n) noexcept {
+        ASSERT(_Ptr != nullptr);
+        ASSERT(__my_base::_peek_refcount32_value(_Ptr) >= 1);
+        if (__my_base::_refcountful_is_immortal(_Ptr))
+            return;
+        *(uint32_t*)__my_base::__get_refcount32_p(_Ptr) += uint32_t(n);
+    }
+
+    static void _refcountful_release(ELEM* _Ptr) noexcept {
+        ASSERT(_Ptr != nullptr);
+        ASSERT(__my_base::_peek_refcount32_value(_Ptr) >= 1);
+        if (__my_base::_refcountful_is_immortal(_Ptr))
+            return;
+        uint32_t new_value = --*(uint32_t*)__my_base::__get_refcount32_p(_Ptr);
+        if (new_value == 0) {
+            __my_base::deallocate(_Ptr);
+        }
+        else if (new_value == 1) {
+            *(uint32_t*)__my_base::__get_flags32_p(_Ptr) |= __my_base::_FLAG_COMPACT_CANDIDATE;
+        }
+    }
+};
+
+
+//the allocator policy of the string types whose inline footprint (the sizeof the string object) is SSO_FIX_SIZE bytes instead of the default one,
+//so that more chars are kept in sso (e.g. 32 bytes: 29 chars or 14 WCHARs, instead of 13 or 6), and the buffers are the BASE_ALLOC's.
+//note: the SSO_FIX_SIZE must be a multiple of the sso alignment (the pointer's, or 16 for char and WCHAR of ks_basic_string_aligned_allocator).
+template <class ELEM, size_t SSO_FIX_SIZE_, class BASE_ALLOC = ks_basic_string_allocator<ELEM>>
+class MODERN_STRING_INLINE_API ks_basic_string_sso_allocator : public BASE_ALLOC {
+    static_assert(std::is_same_v<typename BASE_ALLOC::value_type, ELEM>, "the value_type of BASE_ALLOC must be ELEM");
+
+public:
+    static constexpr size_t SSO_FIX_SIZE = SSO_FIX_SIZE_;
+
+    constexpr ks_basic_string_sso_allocator() noexcept {}
+    constexpr ks_basic_string_sso_allocator(const ks_basic_string_sso_allocator&) noexcept {}
+
+    template <class ELEM2, class BASE_ALLOC2>
+    constexpr ks_basic_string_sso_allocator(const ks_basic_string_sso_allocator<ELEM2, SSO_FIX_SIZE_, BASE_ALLOC2>&) noexcept {}
+
+    template <class ELEM2>
+    struct rebind { using other = ks_basic_string_sso_allocator<ELEM2, SSO_FIX_SIZE_, typename BASE_ALLOC::template rebind<ELEM2>::other>; };
+};
+
+
+//the allocator policy of the string types with the wide layout, whose offset and length are 64 bits instead of 31 bits,
+//so that a string (and its slices) may be beyond 2GB, e.g. a large log or corpus file (see also ks_string_util::map_wide_file), and the buffers are the BASE_ALLOC's.
+//the string object is 32 bytes at least (29 chars or 14 WCHARs in sso), and the strings are converted to the compact ones by copying.
+template <class ELEM, class BASE_ALLOC = ks_basic_string_allocator<ELEM>>
+class MODERN_STRING_INLINE_API ks_basic_string_wide_allocator : public BASE_ALLOC {
+    static_assert(std::is_same_v<typename BASE_ALLOC::value_type, ELEM>, "the value_type of BASE_ALLOC must be ELEM");
+
+public:
+    static constexpr bool WIDE_LAYOUT = true;
+
+    constexpr ks_basic_string_wide_allocator() noexcept {}
+    constexpr ks_basic_string_wide_allocator(const ks_basic_string_wide_allocator&) noexcept {}
+
+    template <class ELEM2, class BASE_ALLOC2>
+    constexpr ks_basic_string_wide_allocator(const ks_basic_string_wide_allocator<ELEM2, BASE_ALLOC2>&) noexcept {}
+
+    template <class ELEM2>
+    struct rebind { using other = ks_basic_string_wide_allocator<ELEM2, typename BASE_ALLOC::template rebind<ELEM2>::other>; };
+};
+
+
+//the allocator policy of the string types whose sso unions are aligned to ks_basic_string_buffer_traits::ALIGNED_SSO_ALIGNMENT (16 for char and WCHAR),
+//so that every 16-aligned block overlapping the data of sso strings is readable, as the heap buffers (see also ks_basic_string_buffer_traits::ALIGNED_ALIGNMENT).
+//note: it raises the alignof of the string objects (and so the layout of the structs holding them), the default strings keep the natural alignment.
+template <class ELEM, class BASE_ALLOC = ks_basic_string_allocator<ELEM>>
+class MODERN_STRING_INLINE_API ks_basic_string_aligned_allocator : public BASE_ALLOC {
+    static_assert(std::is_same_v<typename BASE_ALLOC::value_type, ELEM>, "the value_type of BASE_ALLOC must be ELEM");
+
+public:
+    static constexpr size_t SSO_ALIGNMENT = ks_basic_string_buffer_traits<ELEM>::ALIGNED_SSO_ALIGNMENT;
+
+    constexpr ks_basic_string_aligned_allocator() noexcept {}
+    constexpr ks_basic_string_aligned_allocator(const ks_basic_string_aligned_allocator&) noexcept {}
+
+    template <class ELEM2, class BASE_ALLOC2>
+    constexpr ks_basic_string_aligned_allocator(const ks_basic_string_aligned_allocator<ELEM2, BASE_ALLOC2>&) noexcept {}
+
+    template <class ELEM2>
+    struct rebind { using other = ks_basic_string_aligned_allocator<ELEM2, typename BASE_ALLOC::template rebind<ELEM2>::other>; };
 };
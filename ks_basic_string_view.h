@@ -17,15 +17,36 @@ limitations under the License.
 
 #include "ks_basic_pointer_iterator.h"
 #include <algorithm>
+#include <cstring>
 #include <stdexcept>
 #include <string>
 #include <vector>
 #include <ostream>
 
-template <class ELEM>
+template <class ELEM, class ALLOC>
 class ks_basic_xmutable_string_base;
 
 
+//memory guarantees of the data of ks strings (heap buffers and sso unions, but not the literals referenced as constant, nor the adopted external buffers):
+//every ALIGNMENT-aligned block of ALIGNMENT bytes which overlaps the data (including the end-ch0) is readable,
+//so the vectorized kernels can use full-width aligned loads for the head and tail, instead of scalar code.
+//the sso unions keep the natural alignment by default, so that the string objects keep their size and alignment,
+//and the strings of ks_basic_string_aligned_allocator guarantee the wider ALIGNED_ALIGNMENT.
+template <class ELEM>
+struct ks_basic_string_buffer_traits {
+	static constexpr size_t HEAP_ALIGNMENT = 16; //heap buffers are aligned, and their space is padded to it
+	static constexpr size_t SSO_ALIGNMENT = alignof(void*); //sso unions are aligned (naturally, by the pointer), and their size is multi of it
+	static constexpr size_t ALIGNED_SSO_ALIGNMENT = sizeof(ELEM) <= 2 ? 16 : 8; //the sso unions of ks_basic_string_aligned_allocator
+	static constexpr size_t ALIGNMENT = std::min(HEAP_ALIGNMENT, SSO_ALIGNMENT);
+	static constexpr size_t ALIGNED_ALIGNMENT = std::min(HEAP_ALIGNMENT, ALIGNED_SSO_ALIGNMENT);
+
+	//the end of the aligned block which contains p (p should point into the data of a ks string)
+	static const ELEM* readable_end(const ELEM* p) noexcept {
+		return (const ELEM*)((uintptr_t(p) + ALIGNMENT) & ~uintptr_t(ALIGNMENT - 1));
+	}
+};
+
+
 template <class ELEM>
 class MODERN_STRING_API ks_basic_string_view {
 	static_assert(std::is_trivial_v<ELEM> && std::is_standard_layout_v<ELEM>, "ELEM must be pod type");
@@ -59,7 +80,8 @@ public:
 	ks_basic_string_view& operator=(ks_basic_string_view&& other) noexcept = default;
 
 	//implicit ctor (from ks_xmutable_string, needed until c++17)
-	ks_basic_string_view(const ks_basic_xmutable_string_base<ELEM>& str) noexcept
+	template <class ALLOC>
+	ks_basic_string_view(const ks_basic_xmutable_string_base<ELEM, ALLOC>& str) noexcept
 		: m_p(str.data()), m_length(str.length()) {}
 
 	//implicit ctor (from std::basic_string, needed until c++17)
@@ -264,15 +286,18 @@ protected:
 	static constexpr inline ks_basic_string_view<ELEM> __to_basic_string_view(const ks_basic_string_view<ELEM>& str_view) noexcept { return str_view; }
 	static constexpr inline ks_basic_string_view<ELEM> __to_basic_string_view(const ks_basic_string_view<ELEM>& str_view, size_t offset, size_t count) noexcept { return str_view.substr(offset, count); }
 
-	static constexpr inline ks_basic_string_view<ELEM> __to_basic_string_view(const ks_basic_xmutable_string_base<ELEM>& str) noexcept { return str.view(); }
-	static constexpr inline ks_basic_string_view<ELEM> __to_basic_string_view(const ks_basic_xmutable_string_base<ELEM>& str, size_t offset, size_t count) noexcept { return str.view().substr(offset, count); }
+	template <class ALLOC>
+	static constexpr inline ks_basic_string_view<ELEM> __to_basic_string_view(const ks_basic_xmutable_string_base<ELEM, ALLOC>& str) noexcept { return str.view(); }
+	template <class ALLOC>
+	static constexpr inline ks_basic_string_view<ELEM> __to_basic_string_view(const ks_basic_xmutable_string_base<ELEM, ALLOC>& str, size_t offset, size_t count) noexcept { return str.view().substr(offset, count); }
 
 	template <class CharTraits, class AllocType>
 	static constexpr inline ks_basic_string_view<ELEM> __to_basic_string_view(const std::basic_string<ELEM, CharTraits, AllocType>& str) noexcept { return ks_basic_string_view<ELEM>(str.data(), str.length()); }
 	template <class CharTraits, class AllocType>
 	static constexpr inline ks_basic_string_view<ELEM> __to_basic_string_view(const std::basic_string<ELEM, CharTraits, AllocType>& str, size_t offset, size_t count) noexcept { return ks_basic_string_view<ELEM>(str.data(), str.length()).substr(offset, count); }
 
-	friend class ks_basic_xmutable_string_base<ELEM>;
+	template <class ELEM2, class ALLOC2>
+	friend class ks_basic_xmutable_string_base;
 };
 
 
@@ -214,19 +214,40 @@ namespace std {
 		using argument_type = ks_basic_string_view<ELEM>;
 		using result_type = size_t;
 
+		//hashed in blocks of 16 bytes (the last one is zero-padded, and there is one block at least),
+		//so that a zero-padded sso buffer is hashed in words without loop, see also ks_basic_xmutable_string_base::__hash
 		_NO_INLINE size_t operator()(const ks_basic_string_view<ELEM>& str_view) const noexcept {
-			constexpr size_t _FNV_offset_basis = sizeof(size_t) == 8 ? (size_t)14695981039346656037ULL : (size_t)2166136261UL;
-			constexpr size_t _FNV_prime = sizeof(size_t) == 8 ? (size_t)1099511628211ULL : (size_t)16777619UL;
-
-			size_t hash_val = _FNV_offset_basis;
-			const ELEM* data = str_view.data();
-			const ELEM* data_end = data + str_view.length();
-			for (; data < data_end; ++data) {
-				hash_val ^= static_cast<size_t>(*data);
-				hash_val *= _FNV_prime;
+			const uint8_t* data = (const uint8_t*)str_view.data();
+			const size_t size = str_view.length() * sizeof(ELEM);
+
+			uint64_t hash_val = __HASH_SEED;
+			size_t pos = 0;
+			for (; size - pos > 16; pos += 16) {
+				uint64_t block[2];
+				memcpy(block, data + pos, 16);
+				hash_val = __hash_block(hash_val, block[0], block[1]);
 			}
 
-			return hash_val;
+			uint64_t last_block[2] = { 0, 0 };
+			if (size != pos)
+				memcpy(last_block, data + pos, size - pos);
+			hash_val = __hash_block(hash_val, last_block[0], last_block[1]);
+			return __hash_final(hash_val, size);
+		}
+
+		static constexpr uint64_t __HASH_SEED = 14695981039346656037ULL;
+
+		static constexpr uint64_t __hash_block(uint64_t hash_val, uint64_t word0, uint64_t word1) noexcept {
+			return __hash_mix((__hash_mix(hash_val ^ word0) + 0x9E3779B97F4A7C15ULL) ^ word1);
+		}
+
+		static constexpr size_t __hash_final(uint64_t hash_val, size_t size) noexcept {
+			return size_t(__hash_mix(hash_val ^ uint64_t(size)));
+		}
+
+		static constexpr uint64_t __hash_mix(uint64_t x) noexcept {
+			x = (x ^ (x >> 32)) * 0xD6E8FEB86659FD93ULL;
+			return x ^ (x >> 32);
 		}
 	};
 }
@@ -18,21 +18,26 @@ limitations under the License.
 #include "ks_string_view.h"
 #include "ks_basic_pointer_iterator.h"
 #include "ks_basic_string_allocator.h"
+#include "ks_string_slice_policy.h"
+#include "ks_string_external_buffer.h"
 #include <algorithm>
+#include <cstddef>
 #include <stdexcept>
 #include <string>
 #include <vector>
 #include <ostream>
 
-template <class ELEM>
+template <class ELEM, class ALLOC = ks_basic_string_allocator<ELEM>>
 class ks_basic_mutable_string;
-template <class ELEM>
+template <class ELEM, class ALLOC = ks_basic_string_allocator<ELEM>>
 class ks_basic_immutable_string;
 
 
-template <class ELEM>
+//the ALLOC is the allocator policy of string buffers, see also ks_basic_string_allocator
+template <class ELEM, class ALLOC = ks_basic_string_allocator<ELEM>>
 class MODERN_STRING_API ks_basic_xmutable_string_base {
 	static_assert(std::is_trivial_v<ELEM> && std::is_standard_layout_v<ELEM>, "ELEM must be pod type");
+	static_assert(std::is_same_v<typename ALLOC::value_type, ELEM>, "the value_type of ALLOC must be ELEM");
 
 public:
 	using size_type = size_t;
@@ -60,18 +65,20 @@ public:
 	//copy & move ctor
 	ks_basic_xmutable_string_base(const ks_basic_xmutable_string_base& other) noexcept {
 		if (other.is_sso_mode()) {
-			*_my_sso_ptr() = *other._my_sso_ptr();
+			m_data_union = other.m_data_union; //with the zero padding
 		}
 		else {
 			*_my_ref_ptr() = *other._my_ref_ptr();
 			if (!_my_ref_ptr()->constantFlag)
-				ks_basic_string_allocator<ELEM>::_refcountful_addref(_my_ref_ptr()->alloc_addr());
+				ALLOC::_refcountful_addref(_my_ref_ptr()->alloc_addr());
+			else if (_my_ref_ptr()->is_external())
+				ks_string_external_buffer::__addref_block(_my_ref_ptr()->external_index());
 		}
 	}
 
 	ks_basic_xmutable_string_base(ks_basic_xmutable_string_base&& other) noexcept {
 		if (other.is_sso_mode()) 
-			*_my_sso_ptr() = *other._my_sso_ptr();
+			m_data_union = other.m_data_union;
 		else 
 			*_my_ref_ptr() = *other._my_ref_ptr();
 		other.__zero_init();
@@ -81,17 +88,19 @@ public:
 		if (this != &other) {
 			if (other.is_sso_mode()) {
 				this->~ks_basic_xmutable_string_base();
-				*_my_sso_ptr() = *other._my_sso_ptr();
+				m_data_union = other.m_data_union;
 			}
 			else {
-				if (_my_ref_ptr()->alloc_addr() == other._my_ref_ptr()->alloc_addr()) {
+				if (this->is_ref_mode() && !other._my_ref_ptr()->constantFlag && _my_ref_ptr()->alloc_addr() == other._my_ref_ptr()->alloc_addr()) {
 					*_my_ref_ptr() = *other._my_ref_ptr();
 				}
 				else {
+					if (other._my_ref_ptr()->is_external())
+						ks_string_external_buffer::__addref_block(other._my_ref_ptr()->external_index()); //before the release of this, which may be the last ref of the same block
 					this->~ks_basic_xmutable_string_base();
 					*_my_ref_ptr() = *other._my_ref_ptr();
 					if (!_my_ref_ptr()->constantFlag)
-						ks_basic_string_allocator<ELEM>::_refcountful_addref(_my_ref_ptr()->alloc_addr());
+						ALLOC::_refcountful_addref(_my_ref_ptr()->alloc_addr());
 				}
 			}
 		}
@@ -102,7 +111,7 @@ public:
 		if (this != &other) {
 			this->~ks_basic_xmutable_string_base();
 			if (other.is_sso_mode())
-				*_my_sso_ptr() = *other._my_sso_ptr();
+				m_data_union = other.m_data_union;
 			else
 				*_my_ref_ptr() = *other._my_ref_ptr();
 			other.__zero_init();
@@ -113,14 +122,17 @@ public:
 	//dtor
 	_NO_INLINE ~ks_basic_xmutable_string_base() noexcept {
 		if (this->is_ref_mode() && !this->_my_ref_ptr()->constantFlag) {
-			ks_basic_string_allocator<ELEM>::_refcountful_release(_my_ref_ptr()->alloc_addr());
+			ALLOC::_refcountful_release(_my_ref_ptr()->alloc_addr());
+		}
+		else if (this->is_ref_mode() && this->_my_ref_ptr()->is_external()) {
+			ks_string_external_buffer::__release_block(_my_ref_ptr()->external_index());
 		}
 	}
 
 protected:
-	//zero ctor
+	//zero ctor, the whole union is zeroed so that the sso buffer is zero-padded (see also _sso_set_length)
 	inline void __zero_init() noexcept {
-		m_data_union.__mini_zero = 0;
+		memset(&m_data_union, 0, sizeof(m_data_union));
 	}
 
 	//explicit ctor
@@ -129,19 +141,86 @@ protected:
 
 	explicit ks_basic_xmutable_string_base(const ks_basic_string_view<ELEM>& str_view);
 	explicit ks_basic_xmutable_string_base(size_t count, ELEM ch);
-	explicit ks_basic_xmutable_string_base(std::basic_string<ELEM, std::char_traits<ELEM>, ks_basic_string_allocator<ELEM>>&& str_rvref);
+	explicit ks_basic_xmutable_string_base(std::basic_string<ELEM, std::char_traits<ELEM>, ALLOC>&& str_rvref);
+
+	//explicit ctor (from another ALLOC policy, e.g. ks_basic_string_local_allocator)
+	//the buffer is never shared across the policies, it is adopted only if exclusive (or constant) and of the same layout, or else copied
+	template <class ALLOC2, class _ = std::enable_if_t<!std::is_same_v<ALLOC2, ALLOC>>>
+	explicit ks_basic_xmutable_string_base(const ks_basic_xmutable_string_base<ELEM, ALLOC2>& other) {
+		static_assert(std::is_same_v<typename ALLOC2::memory_type, typename ALLOC::memory_type>, "the ALLOC policies must share the same memory");
+		constexpr bool same_layout = ALLOC2::WIDE_LAYOUT == ALLOC::WIDE_LAYOUT; //the ref-struct is copied across the same layout only
+		if (other.is_sso_mode() && sizeof(m_data_union) == sizeof(other.m_data_union)) {
+			memcpy(&m_data_union, &other.m_data_union, sizeof(m_data_union));
+		}
+		else if (same_layout && other.is_ref_mode() && other._my_ref_ptr()->constantFlag) {
+			this->__zero_init();
+			memcpy(_my_ref_ptr(), other._my_ref_ptr(), sizeof(*_my_ref_ptr()));
+			if (_my_ref_ptr()->is_external())
+				ks_string_external_buffer::__addref_block(_my_ref_ptr()->external_index());
+		}
+		else {
+			this->__zero_init();
+			*this = ks_basic_xmutable_string_base(other.view());
+		}
+	}
+
+	template <class ALLOC2, class _ = std::enable_if_t<!std::is_same_v<ALLOC2, ALLOC>>>
+	explicit ks_basic_xmutable_string_base(ks_basic_xmutable_string_base<ELEM, ALLOC2>&& other) {
+		static_assert(std::is_same_v<typename ALLOC2::memory_type, typename ALLOC::memory_type>, "the ALLOC policies must share the same memory");
+		constexpr bool same_layout = ALLOC2::WIDE_LAYOUT == ALLOC::WIDE_LAYOUT; //the ref-struct is copied across the same layout only
+		if (other.is_sso_mode() && sizeof(m_data_union) == sizeof(other.m_data_union)) {
+			memcpy(&m_data_union, &other.m_data_union, sizeof(m_data_union));
+			other.__zero_init();
+		}
+		else if (same_layout && other.is_ref_mode() && (other._my_ref_ptr()->constantFlag ||
+			ALLOC2::_peek_refcount32_value(other._my_ref_ptr()->alloc_addr(), true) == 1)) {
+			if (!other._my_ref_ptr()->constantFlag)
+				ALLOC2::_refcountful_unbias(other._my_ref_ptr()->alloc_addr());
+			this->__zero_init();
+			memcpy(_my_ref_ptr(), other._my_ref_ptr(), sizeof(*_my_ref_ptr()));
+			other.__zero_init();
+		}
+		else {
+			this->__zero_init();
+			*this = ks_basic_xmutable_string_base(other.view());
+		}
+	}
 
 	enum class __constant_mark { v };
 	_NO_INLINE explicit ks_basic_xmutable_string_base(__constant_mark, const ELEM* sz, size_t length) noexcept {
-		ASSERT(sz != nullptr && length <= _STR_LENGTH_LIMIT && sz[length] == 0);
+		ASSERT(sz != nullptr && length < _EXTERNAL_MARK && sz[length] == 0); //so that the tail never reaches the external mark
 		auto* ref_ptr = _my_ref_ptr();
 		ref_ptr->mode = _REF_MODE;
-		ref_ptr->offset32 = 0;
-		ref_ptr->length32 = (uint32_t)length;
+		ref_ptr->offset32 = 0; //no tail
+		ref_ptr->length32 = (_REF_UINT)length;
 		ref_ptr->constantFlag = true;
 		ref_ptr->p = sz;
 	}
 
+	//adopt the external buffer, or copy it into sso and release it at once if small (the buffer is not adopted if exception thrown)
+	enum class __external_mark { v };
+	_NO_INLINE explicit ks_basic_xmutable_string_base(__external_mark, const ELEM* p, size_t length, ks_string_external_buffer::release_fn release_fn, void* ctx) {
+		if (length > _STR_LENGTH_LIMIT)
+			throw std::overflow_error("ks_basic_xmutable_string_base::from_external(p, count) overflow exception");
+
+		if (length <= _SSO_BUFFER_SPACE - 1) {
+			this->__zero_init();
+			*this = ks_basic_xmutable_string_base(p, length);
+			if (release_fn != nullptr)
+				release_fn(p, length * sizeof(ELEM), ctx);
+			return;
+		}
+
+		const uint32_t block_index = ks_string_external_buffer::__acquire_block(p, length * sizeof(ELEM), release_fn, ctx);
+		ASSERT(block_index < ks_string_external_buffer::MAX_BLOCK_COUNT);
+		auto* ref_ptr = _my_ref_ptr();
+		ref_ptr->mode = _REF_MODE;
+		ref_ptr->offset32 = _EXTERNAL_MARK | block_index;
+		ref_ptr->length32 = (_REF_UINT)length;
+		ref_ptr->constantFlag = true;
+		ref_ptr->p = p;
+	}
+
 	//detach-void
 	ks_basic_xmutable_string_base do_detach() noexcept {
 		ks_basic_xmutable_string_base ret(std::move(*this));
@@ -165,7 +244,11 @@ public:
 	const_reverse_iterator crend() const noexcept { return reverse_iterator{ this->cbegin() }; }
 
 protected:
-	bool do_check_end_ch0() const noexcept { return this->data()[this->length()] == 0; }
+	bool do_check_end_ch0() const noexcept {
+		if (this->is_ref_mode() && _my_ref_ptr()->is_external())
+			return false; //the external buffer has no end-ch0, and must not be read beyond
+		return this->data()[this->length()] == 0;
+	}
 	void do_ensure_end_ch0(bool ensure_end_ch0) noexcept {
 		if (ensure_end_ch0 && !this->do_check_end_ch0()) {
 			this->do_ensure_exclusive();
@@ -179,6 +262,9 @@ protected:
 	void do_auto_grow(size_t grow);
 
 	void do_reserve(size_t capa);
+	bool do_try_regrow(size_t capa);
+
+	bool do_try_compact() noexcept;
 
 	void do_resize(size_t count, ELEM ch, bool ch_valid, bool ensure_end_ch0) {
 		size_t old_length = this->length();
@@ -218,7 +304,7 @@ protected:
 			auto* ref_ptr = _my_ref_ptr();
 			if (!ref_ptr->constantFlag && (
 				ref_ptr->offset32 != 0 ||
-				ref_ptr->offset32 + ref_ptr->length32 != ks_basic_string_allocator<ELEM>::_get_space32_value(ref_ptr->alloc_addr()) - 1)) {
+				ref_ptr->offset32 + ref_ptr->length32 != ALLOC::_get_space_value(ref_ptr->alloc_addr()) - 1)) {
 				*this = ks_basic_xmutable_string_base(this->data(), this->length());
 			}
 		}
@@ -253,6 +339,7 @@ public:
 	int compare(const ELEM* p) const noexcept { return this->view().compare(p); }
 	int compare(const ELEM* p, size_t count) const noexcept { return this->view().compare(p, count); }
 	int compare(const ks_basic_string_view<ELEM>& str_view) const noexcept { return this->view().compare(str_view); }
+	int compare(const ks_basic_xmutable_string_base& other) const noexcept { return this->__compare(other); }
 
 	bool contains(const ELEM* p) const { return this->view().contains(p); }
 	bool contains(const ELEM* p, size_t count) const { return this->view().contains(p, count); }
@@ -300,7 +387,7 @@ public:
 	size_t find_last_not_of(ELEM ch, size_t pos = -1) const { return this->view().find_last_of(ch, pos); }
 
 protected:
-	_NO_INLINE ks_basic_xmutable_string_base do_slice(size_t from, size_t to) const noexcept {
+	_NO_INLINE ks_basic_xmutable_string_base do_slice(size_t from, size_t to) const {
 		const size_t this_length = this->length();
 		if (from > this_length)
 			from = this_length;
@@ -321,22 +408,47 @@ protected:
 	}
 
 protected:
-	ks_basic_xmutable_string_base unsafe_substr(size_t pos, size_t count) const noexcept {
+	//if batched_ref_count is not null, a shared slice is made without addref, and counted to it instead (the caller adds the refs in batch then)
+	ks_basic_xmutable_string_base unsafe_substr(size_t pos, size_t count, size_t* batched_ref_count = nullptr, bool may_copy_out = true) const {
 		ASSERT(this->view().unsafe_subview(pos, count + 1).is_subview_of(this->unsafe_whole_view()));
-		if (count <= _SSO_BUFFER_SPACE - 1 && !(this->is_ref_mode() && this->_my_ref_ptr()->constantFlag)) {
+		if (count <= _SSO_BUFFER_SPACE - 1 && !(this->is_ref_mode() && this->_my_ref_ptr()->constantFlag && !this->_my_ref_ptr()->is_external())) {
+			return ks_basic_xmutable_string_base(this->view().data() + (ptrdiff_t)pos, count);
+		}
+		else if (may_copy_out && this->is_ref_mode() && !this->_my_ref_ptr()->constantFlag && this->do_determine_copy_out_slice(count)) {
+			//copy-out, so that the small slice won't pin the whole buffer
 			return ks_basic_xmutable_string_base(this->view().data() + (ptrdiff_t)pos, count);
 		}
 		else {
-			ks_basic_xmutable_string_base slice = *this;
+			ks_basic_xmutable_string_base slice;
+			if (batched_ref_count != nullptr && !this->_my_ref_ptr()->constantFlag) {
+				*slice._my_ref_ptr() = *this->_my_ref_ptr();
+				++*batched_ref_count;
+			}
+			else {
+				slice = *this;
+			}
 			ASSERT(slice.is_ref_mode());
 			auto* slice_ref_ptr = slice._my_ref_ptr();
+			if (!slice_ref_ptr->constantFlag)
+				slice_ref_ptr->offset32 += (_REF_UINT)pos;
+			else if (!slice_ref_ptr->is_external()) //the block index of external buffer is kept
+				slice_ref_ptr->offset32 += (_REF_UINT)(slice_ref_ptr->length32 - pos - count); //the tail grows
 			slice_ref_ptr->p += (ptrdiff_t)pos;
-			slice_ref_ptr->offset32 += (int32_t)(ptrdiff_t)pos;
-			slice_ref_ptr->length32 = (uint32_t)count;
+			slice_ref_ptr->length32 = (_REF_UINT)count;
 			return slice;
 		}
 	}
 
+	bool do_determine_copy_out_slice(size_t count) const noexcept {
+		const size_t slice_size = count * sizeof(ELEM);
+		const size_t buffer_size = ALLOC::_get_space_value(_my_ref_ptr()->alloc_addr()) * sizeof(ELEM);
+		const bool copied_out = ks_string_slice_policy::should_copy_out(slice_size, buffer_size);
+#ifdef MODERN_STRING_STATS_ENABLED
+		ks_string_memory_stats::__record_slice(slice_size, buffer_size, copied_out);
+#endif
+		return copied_out;
+	}
+
 	ks_basic_string_view<ELEM> unsafe_whole_view() const noexcept {
 		if (this->is_sso_mode()) {
 			auto* sso_ptr = _my_sso_ptr();
@@ -344,17 +456,21 @@ protected:
 		}
 		else {
 			auto* ref_ptr = _my_ref_ptr();
+			if (ref_ptr->constantFlag)
+				return ks_basic_string_view<ELEM>(ref_ptr->p, ref_ptr->length32 + ref_ptr->constant_tail() + 1); //from this string to the literal's end-ch0
 			ELEM* alloc_addr = ref_ptr->alloc_addr();
-			return ref_ptr->constantFlag 
-				? ks_basic_string_view<ELEM>(alloc_addr, ref_ptr->p != nullptr ? ref_ptr->offset32 + ref_ptr->length32 + ks_basic_string_view<ELEM>::__c_strlen(ref_ptr->p + ref_ptr->length32) + 1 : 0)
-				: ks_basic_string_view<ELEM>(alloc_addr, ks_basic_string_allocator<ELEM>::_get_space32_value(alloc_addr));
+			return ks_basic_string_view<ELEM>(alloc_addr, ALLOC::_get_space_value(alloc_addr));
 		}
 	}
 
 protected:
-	template <class STR_TYPE, class _ = std::enable_if_t<std::is_base_of_v<ks_basic_xmutable_string_base<ELEM>, STR_TYPE>>>
+	template <class STR_TYPE, class _ = std::enable_if_t<std::is_base_of_v<ks_basic_xmutable_string_base<ELEM, ALLOC>, STR_TYPE>>>
 	std::vector<STR_TYPE> do_split(const ks_basic_string_view<ELEM>& sep, size_t n) const;
 
+	//the slices of many subviews of this, the shared ones are addref-ed in batch (by one atomic RMW, instead of one per slice)
+	template <class STR_TYPE, class _ = std::enable_if_t<std::is_base_of_v<ks_basic_xmutable_string_base<ELEM, ALLOC>, STR_TYPE>>>
+	std::vector<STR_TYPE> do_bulk_substr(const std::vector<ks_basic_string_view<ELEM>>& sub_view_seq, bool may_copy_out = true) const;
+
 public:
 	const ELEM& front() const {
 		ASSERT(!this->empty());
@@ -379,22 +495,17 @@ public:
 	}
 
 public:
+	//branch-free, both modes' values are read from the data union and selected by the mode bit (they are in the innermost loops of view-based code)
 	const ELEM* data() const noexcept {
-		return this->is_sso_mode()
-			? _my_sso_ptr()->buffer
-			: _my_ref_ptr()->p;
+		return (const ELEM*)_select_by_mode(uintptr_t(_my_sso_ptr()->buffer), uintptr_t(_my_ref_ptr()->p));
 	}
 
 	const ELEM* data_end() const noexcept {
-		return this->is_sso_mode()
-			? _my_sso_ptr()->buffer + _my_sso_ptr()->length8
-			: _my_ref_ptr()->p + _my_ref_ptr()->length32;
+		return this->data() + this->length();
 	}
 
 	size_t length() const noexcept {
-		return this->is_sso_mode()
-			? _my_sso_ptr()->length8
-			: _my_ref_ptr()->length32;
+		return _select_by_mode(size_t(_my_sso_ptr()->length8), size_t(_my_ref_ptr()->length32));
 	}
 
 	size_t size() const noexcept { return this->length(); }
@@ -405,23 +516,70 @@ public:
 			return _SSO_BUFFER_SPACE - 1;
 		else 
 			return this->_my_ref_ptr()->constantFlag 
-				? _my_ref_ptr()->length32 + ks_basic_string_view<ELEM>::__c_strlen(_my_ref_ptr()->p + _my_ref_ptr()->length32)
-				: (ks_basic_string_allocator<ELEM>::_get_space32_value(_my_ref_ptr()->alloc_addr()) - 1) - _my_ref_ptr()->offset32;
+				? _my_ref_ptr()->length32 + _my_ref_ptr()->constant_tail()
+				: (ALLOC::_get_space_value(_my_ref_ptr()->alloc_addr()) - 1) - _my_ref_ptr()->offset32;
 	}
 
+	//the sso storage is always exclusive, so that it's mutated in place instead of forked to heap
 	bool is_exclusive() const noexcept {
 		if (this->is_sso_mode())
-			return false;
+			return true;
 		else 
 			return _my_ref_ptr()->constantFlag 
 				? false 
-				: (ks_basic_string_allocator<ELEM>::_peek_refcount32_value(_my_ref_ptr()->alloc_addr(), false) == 1); //note: not need with acquire-order
+				: (ALLOC::_peek_refcount32_value(_my_ref_ptr()->alloc_addr(), false) == 1); //note: not need with acquire-order
+	}
+
+	//whether it refers a refcountful buffer of heap, which is freed by its last owner (not sso, literal, external or arena buffer)
+	bool owns_heap_buffer() const noexcept {
+		return this->is_ref_mode() && !_my_ref_ptr()->constantFlag && !ALLOC::_refcountful_is_arena(_my_ref_ptr()->alloc_addr());
+	}
+
+	//bytes of the shared buffer which are kept alive but not referenced by this string, for diagnosing the slice-pinning
+	size_t pinned_bytes() const noexcept {
+		if (this->is_sso_mode())
+			return 0;
+		else if (_my_ref_ptr()->constantFlag)
+			return _my_ref_ptr()->is_external()
+				? ks_string_external_buffer::__get_block_size(_my_ref_ptr()->external_index()) - _my_ref_ptr()->length32 * sizeof(ELEM)
+				: 0;
+		else
+			return (ALLOC::_get_space_value(_my_ref_ptr()->alloc_addr()) - _my_ref_ptr()->length32) * sizeof(ELEM);
+	}
+
+	//compact the buffer if this string has become its last owner, and covers less than 1/compact_ratio of it (see also ks_string_slice_policy).
+	//returns true if compacted. note: call it where the string is owned (e.g. when a cache is swept), it's not safe with concurrent readers of this string.
+	bool compact() noexcept {
+		if (this->is_sso_mode() || _my_ref_ptr()->constantFlag)
+			return false;
+		else
+			return this->do_try_compact();
 	}
 
 	ks_basic_string_view<ELEM> view() const noexcept {
 		return ks_basic_string_view<ELEM>(this->data(), this->length());
 	}
 
+	//make the shared buffer immortal, then copying and destroying the strings of it never write the refcount, and it's never freed.
+	//for the hot strings shared among threads, see also ks_string_immortal_policy. returns false if it has no refcountful buffer (sso mode), or it can't be (arena or external buffer).
+	bool make_immortal() noexcept {
+		if (this->is_sso_mode())
+			return false;
+		else
+			return _my_ref_ptr()->constantFlag
+				? !_my_ref_ptr()->is_external()
+				: ALLOC::_refcountful_make_immortal(_my_ref_ptr()->alloc_addr());
+	}
+
+	bool is_immortal() const noexcept {
+		if (this->is_sso_mode())
+			return false;
+		else
+			return _my_ref_ptr()->constantFlag
+				? !_my_ref_ptr()->is_external()
+				: ALLOC::_refcountful_is_immortal(_my_ref_ptr()->alloc_addr());
+	}
+
 protected:
 	bool is_sso_mode() const noexcept { return _my_mode() == _SSO_MODE; }
 	bool is_ref_mode() const noexcept { return _my_mode() == _REF_MODE; }
@@ -435,10 +593,20 @@ private:
 	static constexpr uint8_t _REF_MODE = 1;
 
 	static constexpr size_t _MODE_BITS = 1;
-	static constexpr size_t _FIX_DATA_SIZE = std::max(size_t(sizeof(ELEM) <= 2 ? 16 : 24), (sizeof(ELEM) * 2) / 8 * 8); //use 32 is good also, and std::basic_string uses just 32, but we use smaller size for mem-compact
+	static constexpr size_t _DEFAULT_FIX_DATA_SIZE = ALLOC::WIDE_LAYOUT
+		? std::max(size_t(32), (sizeof(ELEM) * 2) / 8 * 8) //the wide ref-struct is 24 bytes
+		: std::max(size_t(sizeof(ELEM) <= 2 ? 16 : 24), (sizeof(ELEM) * 2) / 8 * 8); //use 32 is good also, and std::basic_string uses just 32, but we use smaller size for mem-compact
+	static constexpr size_t _FIX_DATA_SIZE = ALLOC::SSO_FIX_SIZE != 0 ? ALLOC::SSO_FIX_SIZE : _DEFAULT_FIX_DATA_SIZE; //see also ks_basic_string_sso_allocator
 	static constexpr size_t _SSO_BUFFER_SPACE = ((_FIX_DATA_SIZE - 2) / sizeof(ELEM)); //why sub 2? see also _SSO_STRUCT
-	static constexpr size_t _STR_LENGTH_LIMIT = 0x7FFFFFFF; //due to _REF_STRUCT::offset32 is 31 bits actually, so the max len is defined as here
+	using _REF_UINT = std::conditional_t<ALLOC::WIDE_LAYOUT, uint64_t, uint32_t>; //see also ks_basic_string_wide_allocator
+	static constexpr size_t _REF_UINT_BITS = sizeof(_REF_UINT) * 8;
+	static constexpr size_t _STR_LENGTH_LIMIT = size_t(std::min(uint64_t(_REF_UINT(-1) >> _MODE_BITS), uint64_t(SIZE_MAX))); //due to _REF_STRUCT::offset32 is 31 (or 63 for wide layout) bits actually, so the max len is defined as here
+	static constexpr _REF_UINT _EXTERNAL_MARK = _REF_UINT(1) << (_REF_UINT_BITS - _MODE_BITS - 1); //the top bit of _REF_STRUCT::offset32, for constantFlag, marks an external buffer
 	static_assert(_SSO_BUFFER_SPACE != 0, "sso-buffer-space must not be 0");
+	static_assert(_SSO_BUFFER_SPACE <= 0xFF, "sso-buffer-space must fit in _SSO_STRUCT::length8");
+	static constexpr size_t _SSO_ALIGNMENT = std::max(ALLOC::SSO_ALIGNMENT != 0 ? ALLOC::SSO_ALIGNMENT : ks_basic_string_buffer_traits<ELEM>::SSO_ALIGNMENT, alignof(_REF_UINT)); //see also ks_basic_string_aligned_allocator
+	static_assert(_FIX_DATA_SIZE % _SSO_ALIGNMENT == 0, "the fix-data-size must be a multiple of the sso alignment");
+	static_assert(ks_string_external_buffer::MAX_BLOCK_COUNT <= _EXTERNAL_MARK, "the block index must be less than the external mark");
 
 	struct _SSO_STRUCT {
 		uint8_t mode : _MODE_BITS;
@@ -446,24 +614,36 @@ private:
 		ELEM    buffer[_SSO_BUFFER_SPACE];
 	};
 	struct _REF_STRUCT {
-		uint32_t mode : _MODE_BITS;
-		uint32_t offset32 : (32 - _MODE_BITS);
-		uint32_t length32 : (32 - _MODE_BITS);
-		uint32_t constantFlag : 1;
+		_REF_UINT mode : _MODE_BITS;
+		_REF_UINT offset32 : (_REF_UINT_BITS - _MODE_BITS); //for constantFlag, it's the length of the literal's tail after this string instead, so that the capacity is known, or _EXTERNAL_MARK | block-index for an external buffer
+		_REF_UINT length32 : (_REF_UINT_BITS - _MODE_BITS);
+		_REF_UINT constantFlag : 1;
 		const ELEM* p;
 		ELEM* alloc_addr() const noexcept { return const_cast<ELEM*>(this->p) - (size_t)(this->offset32); }
+		bool is_external() const noexcept { return this->constantFlag && (this->offset32 & _EXTERNAL_MARK) != 0; }
+		uint32_t external_index() const noexcept { return uint32_t(this->offset32 & ~_EXTERNAL_MARK); }
+		_REF_UINT constant_tail() const noexcept { return (this->offset32 & _EXTERNAL_MARK) != 0 ? 0 : this->offset32; } //no tail for external buffer
 	};
 
-	union _DATA_UNION {
+	union alignas(_SSO_ALIGNMENT) _DATA_UNION {
 		uint8_t     mode : _MODE_BITS;
 		_SSO_STRUCT sso_struct;
 		_REF_STRUCT ref_struct;
-		uint32_t    __mini_zero;
 	};
 
 	static_assert(sizeof(_SSO_STRUCT) <= _FIX_DATA_SIZE, "the size of SSO_STRUCT is not perfect");
 	static_assert(sizeof(_REF_STRUCT) <= _FIX_DATA_SIZE, "the size of REF_STRUCT it not perfect");
 	static_assert(sizeof(_DATA_UNION) <= _FIX_DATA_SIZE, "the size of DATA_UNION is not perfect");
+	static_assert(sizeof(_DATA_UNION) % _SSO_ALIGNMENT == 0, "the sso buffer should be readable in aligned blocks");
+
+	//in sso mode, the elements after the length are always zero, so the data union is compared and hashed in words.
+	//note: the words are shifted and masked in little-endian order, which the hash of string view matches by its raw bytes
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#	error "the word-wise compare and hash of sso strings assume a little-endian target"
+#endif
+	static constexpr size_t _SSO_WORD_COUNT = sizeof(_DATA_UNION) / 8;
+	static constexpr size_t _SSO_BUFFER_OFFSET = offsetof(_SSO_STRUCT, buffer);
+	static_assert(sizeof(_DATA_UNION) % 8 == 0 && _SSO_BUFFER_OFFSET < 8, "the sso buffer should start in the first word");
 
 	_DATA_UNION m_data_union;
 
@@ -474,6 +654,77 @@ private:
 	constexpr const _SSO_STRUCT* _my_sso_ptr() const noexcept { return &m_data_union.sso_struct; }
 	constexpr const _REF_STRUCT* _my_ref_ptr() const noexcept { return &m_data_union.ref_struct; }
 
+	//select by mask instead of branch, the value of the other mode is garbage but never used
+	template <class T>
+	constexpr T _select_by_mode(T sso_value, T ref_value) const noexcept {
+		const T ref_mask = T(0) - T(_my_mode()); //all ones for ref-mode
+		return sso_value ^ ((sso_value ^ ref_value) & ref_mask);
+	}
+
+	//the length of sso buffer is set by it only, the elements cut off are zeroed to keep the padding
+	void _sso_set_length(size_t length) noexcept {
+		auto* sso_ptr = _my_sso_ptr();
+		if (length < sso_ptr->length8)
+			std::fill(sso_ptr->buffer + length, sso_ptr->buffer + sso_ptr->length8, ELEM(0));
+		sso_ptr->length8 = uint8_t(length);
+	}
+
+	uint64_t _sso_word(size_t i) const noexcept {
+		uint64_t word = 0;
+		if (i < _SSO_WORD_COUNT)
+			memcpy(&word, (const uint8_t*)&m_data_union + i * 8, 8);
+		return word;
+	}
+
+	//the i-th word of the sso buffer (rather than of the union)
+	uint64_t _sso_buffer_word(size_t i) const noexcept {
+		return (this->_sso_word(i) >> (_SSO_BUFFER_OFFSET * 8)) | (this->_sso_word(i + 1) << (64 - _SSO_BUFFER_OFFSET * 8));
+	}
+
+public:
+	//the fast paths of ==, compare and hash for both-sso (see also _sso_set_length)
+	bool __equals(const ks_basic_xmutable_string_base& other) const noexcept {
+		if (this->is_sso_mode() && other.is_sso_mode()) {
+			uint64_t diff = 0;
+			for (size_t i = 0; i < _SSO_WORD_COUNT; ++i)
+				diff |= this->_sso_word(i) ^ other._sso_word(i);
+			return diff == 0;
+		}
+		return this->view() == other.view();
+	}
+	bool __equals(const ks_basic_string_view<ELEM>& other) const noexcept { return this->view() == other; }
+
+	int __compare(const ks_basic_xmutable_string_base& other) const noexcept {
+		if (this->is_sso_mode() && other.is_sso_mode()) {
+			constexpr uint64_t buffer_mask = ~uint64_t(0) << (_SSO_BUFFER_OFFSET * 8); //the mode and length are not compared here
+			for (size_t i = 0; i < _SSO_WORD_COUNT; ++i) {
+				if (((this->_sso_word(i) ^ other._sso_word(i)) & (i == 0 ? buffer_mask : ~uint64_t(0))) != 0) {
+					//the first different element is in this word, and the padding is less than any element
+					const size_t first = i == 0 ? 0 : (i * 8 - _SSO_BUFFER_OFFSET) / sizeof(ELEM);
+					const size_t last = std::min((i * 8 + 8 - _SSO_BUFFER_OFFSET) / sizeof(ELEM), size_t(_SSO_BUFFER_SPACE));
+					return ks_char_traits<ELEM>::compare(_my_sso_ptr()->buffer + first, other._my_sso_ptr()->buffer + first, last - first);
+				}
+			}
+			const size_t my_length = _my_sso_ptr()->length8, other_length = other._my_sso_ptr()->length8;
+			return my_length == other_length ? 0 : my_length < other_length ? -1 : +1;
+		}
+		return this->view().compare(other.view());
+	}
+	int __compare(const ks_basic_string_view<ELEM>& other) const noexcept { return this->view().compare(other); }
+
+	size_t __hash() const noexcept {
+		using hasher = std::hash<ks_basic_string_view<ELEM>>;
+		if (this->is_sso_mode()) {
+			const size_t size = size_t(_my_sso_ptr()->length8) * sizeof(ELEM);
+			const size_t block_count = sizeof(_DATA_UNION) <= 16 || size <= 16 ? 1 : (size + 15) / 16;
+			uint64_t hash_val = hasher::__HASH_SEED;
+			for (size_t i = 0; i < block_count; ++i)
+				hash_val = hasher::__hash_block(hash_val, this->_sso_buffer_word(i * 2), this->_sso_buffer_word(i * 2 + 1));
+			return hasher::__hash_final(hash_val, size);
+		}
+		return hasher()(this->view());
+	}
+
 public:
 	bool operator==(const ks_basic_string_view<ELEM>& right) const noexcept { return this->view() == right; }
 	bool operator!=(const ks_basic_string_view<ELEM>& right) const noexcept { return this->view() != right; }
@@ -489,16 +740,19 @@ protected:
 	static constexpr inline ks_basic_string_view<ELEM> __to_basic_string_view(const ks_basic_string_view<ELEM>& str_view) noexcept { return ks_basic_string_view<ELEM>::__to_basic_string_view(str_view); }
 	static constexpr inline ks_basic_string_view<ELEM> __to_basic_string_view(const ks_basic_string_view<ELEM>& str_view, size_t offset, size_t count) noexcept { return ks_basic_string_view<ELEM>::__to_basic_string_view(str_view, offset, count); }
 
-	static constexpr inline ks_basic_string_view<ELEM> __to_basic_string_view(const ks_basic_xmutable_string_base<ELEM>& str) noexcept { return ks_basic_string_view<ELEM>::__to_basic_string_view(str); }
-	static constexpr inline ks_basic_string_view<ELEM> __to_basic_string_view(const ks_basic_xmutable_string_base<ELEM>& str, size_t offset, size_t count) noexcept { return ks_basic_string_view<ELEM>::__to_basic_string_view(str, offset, count); }
+	static constexpr inline ks_basic_string_view<ELEM> __to_basic_string_view(const ks_basic_xmutable_string_base<ELEM, ALLOC>& str) noexcept { return ks_basic_string_view<ELEM>::__to_basic_string_view(str); }
+	static constexpr inline ks_basic_string_view<ELEM> __to_basic_string_view(const ks_basic_xmutable_string_base<ELEM, ALLOC>& str, size_t offset, size_t count) noexcept { return ks_basic_string_view<ELEM>::__to_basic_string_view(str, offset, count); }
 
 	template <class CharTraits, class AllocType>
 	static constexpr inline ks_basic_string_view<ELEM> __to_basic_string_view(const std::basic_string<ELEM, CharTraits, AllocType>& str) noexcept { return ks_basic_string_view<ELEM>::__to_basic_string_view(str); }
 	template <class CharTraits, class AllocType>
 	static constexpr inline ks_basic_string_view<ELEM> __to_basic_string_view(const std::basic_string<ELEM, CharTraits, AllocType>& str, size_t offset, size_t count) noexcept { return ks_basic_string_view<ELEM>::__to_basic_string_view(str, offset, count); }
 
-	friend class ks_basic_mutable_string<ELEM>;
-	friend class ks_basic_immutable_string<ELEM>;
+	friend class ks_basic_mutable_string<ELEM, ALLOC>;
+	friend class ks_basic_immutable_string<ELEM, ALLOC>;
+
+	template <class ELEM2, class ALLOC2>
+	friend class ks_basic_xmutable_string_base;
 };
 
 
@@ -16,8 +16,8 @@ limitations under the License.
 #pragma once
 
 
-template <class ELEM>
-_NO_INLINE ks_basic_xmutable_string_base<ELEM>::ks_basic_xmutable_string_base(const ks_basic_string_view<ELEM>& str_view) : ks_basic_xmutable_string_base() {
+template <class ELEM, class ALLOC>
+_NO_INLINE ks_basic_xmutable_string_base<ELEM, ALLOC>::ks_basic_xmutable_string_base(const ks_basic_string_view<ELEM>& str_view) : ks_basic_xmutable_string_base() {
 	const ELEM* p = str_view.data();
 	size_t count = str_view.length();
 	if (count > _STR_LENGTH_LIMIT)
@@ -31,21 +31,21 @@ _NO_INLINE ks_basic_xmutable_string_base<ELEM>::ks_basic_xmutable_string_base(co
 		sso_ptr->buffer[count] = 0;
 	}
 	else {
-		ELEM* new_alloc_addr = ks_basic_string_allocator<ELEM>::_refcountful_alloc(count + 1);
+		ELEM* new_alloc_addr = ALLOC::_refcountful_alloc(count + 1);
 		std::copy_n(p, count, new_alloc_addr);
 		new_alloc_addr[count] = 0;
 
 		auto* ref_ptr = _my_ref_ptr();
 		ref_ptr->mode = _REF_MODE;
 		ref_ptr->offset32 = 0;
-		ref_ptr->length32 = uint32_t(count);
+		ref_ptr->length32 = _REF_UINT(count);
 		ref_ptr->constantFlag = false;
 		ref_ptr->p = new_alloc_addr;
 	}
 }
 
-template <class ELEM>
-_NO_INLINE ks_basic_xmutable_string_base<ELEM>::ks_basic_xmutable_string_base(size_t count, ELEM ch) : ks_basic_xmutable_string_base() {
+template <class ELEM, class ALLOC>
+_NO_INLINE ks_basic_xmutable_string_base<ELEM, ALLOC>::ks_basic_xmutable_string_base(size_t count, ELEM ch) : ks_basic_xmutable_string_base() {
 	if (count > _STR_LENGTH_LIMIT)
 		throw std::overflow_error("ks_basic_xmutable_string_base(count, ch) overflow exception");
 
@@ -57,21 +57,21 @@ _NO_INLINE ks_basic_xmutable_string_base<ELEM>::ks_basic_xmutable_string_base(si
 		sso_ptr->buffer[count] = 0;
 	}
 	else {
-		ELEM* new_alloc_addr = ks_basic_string_allocator<ELEM>::_refcountful_alloc(count + 1);
+		ELEM* new_alloc_addr = ALLOC::_refcountful_alloc(count + 1);
 		std::fill_n(new_alloc_addr, count, ch);
 		new_alloc_addr[count] = 0;
 
 		auto* ref_ptr = _my_ref_ptr();
 		ref_ptr->mode = _REF_MODE;
 		ref_ptr->offset32 = 0;
-		ref_ptr->length32 = uint32_t(count);
+		ref_ptr->length32 = _REF_UINT(count);
 		ref_ptr->constantFlag = false;
 		ref_ptr->p = new_alloc_addr;
 	}
 }
 
-template <class ELEM>
-_NO_INLINE ks_basic_xmutable_string_base<ELEM>::ks_basic_xmutable_string_base(std::basic_string<ELEM, std::char_traits<ELEM>, ks_basic_string_allocator<ELEM>>&& str_rvref) : ks_basic_xmutable_string_base() {
+template <class ELEM, class ALLOC>
+_NO_INLINE ks_basic_xmutable_string_base<ELEM, ALLOC>::ks_basic_xmutable_string_base(std::basic_string<ELEM, std::char_traits<ELEM>, ALLOC>&& str_rvref) : ks_basic_xmutable_string_base() {
 	if (str_rvref.length() > _STR_LENGTH_LIMIT)
 		throw std::overflow_error("ks_basic_xmutable_string_base(&&str) overflow exception");
 
@@ -85,33 +85,33 @@ _NO_INLINE ks_basic_xmutable_string_base<ELEM>::ks_basic_xmutable_string_base(st
 	else {
 		ASSERT(strdata_addr[str_rvref.length()] == 0); //should have end-ch0 already
 		ASSERT(strdata_addr[str_rvref.capacity()] == 0); //should have end-ch0 already
-		_refcountful_initref(strdata_addr);
+		ALLOC::_refcountful_initref(strdata_addr);
 
 		auto* ref_ptr = _my_ref_ptr();
 		ref_ptr->mode = _REF_MODE;
 		ref_ptr->offset32 = 0;
-		ref_ptr->length32 = uint32_t(str_rvref.length());
+		ref_ptr->length32 = _REF_UINT(str_rvref.length());
 		ref_ptr->constantFlag = false;
 		ref_ptr->p = strdata_addr;
 
-		::new (&str_rvref) std::basic_string<ELEM, std::char_traits<ELEM>, ks_basic_string_allocator<ELEM>>{}; //moved-like
+		::new (&str_rvref) std::basic_string<ELEM, std::char_traits<ELEM>, ALLOC>{}; //moved-like
 	}
 }
 
-template <class ELEM>
-_NO_INLINE void ks_basic_xmutable_string_base<ELEM>::do_ensure_exclusive() {
+template <class ELEM, class ALLOC>
+_NO_INLINE void ks_basic_xmutable_string_base<ELEM, ALLOC>::do_ensure_exclusive() {
 	if (!this->is_exclusive()) {
 		const size_t my_length = this->length();
 		const size_t my_capacity = this->capacity();
-		ELEM* forked_alloc_addr = ks_basic_string_allocator<ELEM>::_refcountful_alloc(my_capacity + 1);
+		ELEM* forked_alloc_addr = ALLOC::_refcountful_alloc(my_capacity + 1);
 		std::copy_n(this->data(), my_length, forked_alloc_addr);
-		std::fill_n(forked_alloc_addr + my_length, my_capacity - my_length + 1, 0); //with z
+		forked_alloc_addr[my_length] = 0; //the slack is left uninitialized
 
 		ks_basic_xmutable_string_base forked;
 		auto* forked_ref_ptr = forked._my_ref_ptr();
 		forked_ref_ptr->mode = _REF_MODE;
 		forked_ref_ptr->offset32 = 0;
-		forked_ref_ptr->length32 = uint32_t(my_length);
+		forked_ref_ptr->length32 = _REF_UINT(my_length);
 		forked_ref_ptr->constantFlag = false;
 		forked_ref_ptr->p = forked_alloc_addr;
 
@@ -119,8 +119,8 @@ _NO_INLINE void ks_basic_xmutable_string_base<ELEM>::do_ensure_exclusive() {
 	}
 }
 
-template <class ELEM>
-_NO_INLINE void ks_basic_xmutable_string_base<ELEM>::do_auto_grow(size_t grow) {
+template <class ELEM, class ALLOC>
+_NO_INLINE void ks_basic_xmutable_string_base<ELEM, ALLOC>::do_auto_grow(size_t grow) {
 	if (this->do_determine_need_grow(grow)) {
 		const size_t my_capacity = this->capacity();
 		size_t new_capa = std::max(this->length() + grow, my_capacity + my_capacity / 2);
@@ -134,8 +134,8 @@ _NO_INLINE void ks_basic_xmutable_string_base<ELEM>::do_auto_grow(size_t grow) {
 	}
 }
 
-template <class ELEM>
-_NO_INLINE void ks_basic_xmutable_string_base<ELEM>::do_reserve(size_t capa) {
+template <class ELEM, class ALLOC>
+_NO_INLINE void ks_basic_xmutable_string_base<ELEM, ALLOC>::do_reserve(size_t capa) {
 	if (capa > this->capacity()) {
 		size_t new_capa = capa;
 		if (new_capa > _STR_LENGTH_LIMIT) {
@@ -147,16 +147,19 @@ _NO_INLINE void ks_basic_xmutable_string_base<ELEM>::do_reserve(size_t capa) {
 		if (new_capa <= _SSO_BUFFER_SPACE - 1) {
 			*this = ks_basic_xmutable_string_base(this->data(), this->length());
 		}
+		else if (this->is_ref_mode() && this->is_exclusive() && _my_ref_ptr()->offset32 == 0 && this->do_try_regrow(new_capa)) {
+			//regrown (maybe in place)
+		}
 		else {
-			ELEM* grown_alloc_addr = ks_basic_string_allocator<ELEM>::_refcountful_alloc(new_capa + 1);
+			ELEM* grown_alloc_addr = ALLOC::_refcountful_alloc(new_capa + 1);
 			std::copy_n(this->data(), this->length(), grown_alloc_addr);
-			std::fill_n(grown_alloc_addr + this->length(), new_capa - this->length() + 1, 0);
+			grown_alloc_addr[this->length()] = 0; //the slack is left uninitialized
 
 			ks_basic_xmutable_string_base grown;
 			auto* grown_ref_ptr = grown._my_ref_ptr();
 			grown_ref_ptr->mode = _REF_MODE;
 			grown_ref_ptr->offset32 = 0;
-			grown_ref_ptr->length32 = uint32_t(this->length());
+			grown_ref_ptr->length32 = _REF_UINT(this->length());
 			grown_ref_ptr->constantFlag = false;
 			grown_ref_ptr->p = grown_alloc_addr;
 
@@ -166,8 +169,54 @@ _NO_INLINE void ks_basic_xmutable_string_base<ELEM>::do_reserve(size_t capa) {
 }
 
 
-template <class ELEM>
-_NO_INLINE void ks_basic_xmutable_string_base<ELEM>::do_assign(const ks_basic_string_view<ELEM>& str_view, bool ensure_end_ch0) {
+template <class ELEM, class ALLOC>
+_NO_INLINE bool ks_basic_xmutable_string_base<ELEM, ALLOC>::do_try_regrow(size_t capa) {
+	ASSERT(this->is_exclusive() && _my_ref_ptr()->offset32 == 0);
+	ELEM* regrown_alloc_addr = ALLOC::_refcountful_regrow(_my_ref_ptr()->alloc_addr(), capa + 1);
+	if (regrown_alloc_addr == nullptr)
+		return false;
+
+	_my_ref_ptr()->p = regrown_alloc_addr;
+	regrown_alloc_addr[this->length()] = 0; //the slack is left uninitialized
+	return true;
+}
+
+
+template <class ELEM, class ALLOC>
+_NO_INLINE bool ks_basic_xmutable_string_base<ELEM, ALLOC>::do_try_compact() noexcept {
+	ASSERT(this->is_ref_mode() && !_my_ref_ptr()->constantFlag);
+	if (ks_string_slice_policy::compact_ratio() == 0)
+		return false;
+#ifdef MODERN_STRING_BIASED_REFCOUNT_ENABLED
+	ks_string_biased_refcount::perform_queued_releases(); //the other owners may be released by other threads, and queued to this thread
+#endif
+
+	ELEM* alloc_addr = _my_ref_ptr()->alloc_addr();
+	if (!ALLOC::_refcountful_is_compact_candidate(alloc_addr))
+		return false;
+	if (ALLOC::_peek_refcount32_value(alloc_addr, true) != 1)
+		return false; //shared again, keep it marked
+
+	ALLOC::_refcountful_clear_compact_candidate(alloc_addr);
+	if (!ks_string_slice_policy::should_compact(this->length() * sizeof(ELEM), ALLOC::_get_space_value(alloc_addr) * sizeof(ELEM)))
+		return false;
+
+	try {
+		ELEM* shrunk_alloc_addr = _my_ref_ptr()->offset32 == 0 ? ALLOC::_refcountful_shrink(alloc_addr, this->length() + 1) : nullptr;
+		if (shrunk_alloc_addr != nullptr)
+			_my_ref_ptr()->p = shrunk_alloc_addr; //shrunk (maybe in place), the end-ch0 is kept if it exists
+		else
+			*this = ks_basic_xmutable_string_base(this->view()); //relocate
+		return true;
+	}
+	catch (...) {
+		return false; //compacting is just best-effort
+	}
+}
+
+
+template <class ELEM, class ALLOC>
+_NO_INLINE void ks_basic_xmutable_string_base<ELEM, ALLOC>::do_assign(const ks_basic_string_view<ELEM>& str_view, bool ensure_end_ch0) {
 	if (str_view.empty())
 		return this->do_clear(ensure_end_ch0);
 
@@ -196,24 +245,24 @@ _NO_INLINE void ks_basic_xmutable_string_base<ELEM>::do_assign(const ks_basic_st
 	}
 }
 
-template <class ELEM>
-inline void ks_basic_xmutable_string_base<ELEM>::do_assign(size_t count, ELEM ch, bool ch_valid, bool ensure_end_ch0) {
+template <class ELEM, class ALLOC>
+inline void ks_basic_xmutable_string_base<ELEM, ALLOC>::do_assign(size_t count, ELEM ch, bool ch_valid, bool ensure_end_ch0) {
 	this->do_clear(false);
 	this->do_append(ch, ch_valid, ensure_end_ch0);
 }
 
-template <class ELEM>
-inline void ks_basic_xmutable_string_base<ELEM>::do_append(const ks_basic_string_view<ELEM>& str_view, bool ensure_end_ch0) {
+template <class ELEM, class ALLOC>
+inline void ks_basic_xmutable_string_base<ELEM, ALLOC>::do_append(const ks_basic_string_view<ELEM>& str_view, bool ensure_end_ch0) {
 	this->do_insert(this->length(), str_view, ensure_end_ch0);
 }
 
-template <class ELEM>
-inline void ks_basic_xmutable_string_base<ELEM>::do_append(size_t count, ELEM ch, bool ch_valid, bool ensure_end_ch0) {
+template <class ELEM, class ALLOC>
+inline void ks_basic_xmutable_string_base<ELEM, ALLOC>::do_append(size_t count, ELEM ch, bool ch_valid, bool ensure_end_ch0) {
 	this->do_insert(this->length(), count, ch, ch_valid, ensure_end_ch0);
 }
 
-template <class ELEM>
-_NO_INLINE void ks_basic_xmutable_string_base<ELEM>::do_insert(size_t pos, const ks_basic_string_view<ELEM>& str_view, bool ensure_end_ch0) {
+template <class ELEM, class ALLOC>
+_NO_INLINE void ks_basic_xmutable_string_base<ELEM, ALLOC>::do_insert(size_t pos, const ks_basic_string_view<ELEM>& str_view, bool ensure_end_ch0) {
 	if (pos > this->length())
 		throw std::out_of_range("ks_basic_xmutable_string_base::insert(pos, ...) out-of-range exception");
 	if (str_view.empty())
@@ -236,13 +285,13 @@ _NO_INLINE void ks_basic_xmutable_string_base<ELEM>::do_insert(size_t pos, const
 		this->do_auto_grow(str_view.length());
 		this->do_ensure_exclusive();
 
-		std::move_backward(this->data() + pos, this->data() + pos + str_view.length(), this->unsafe_data_end() + str_view.length());
+		std::move_backward(this->data() + pos, this->data_end(), this->unsafe_data_end() + str_view.length());
 		std::copy_n(str_view.data(), str_view.length(), this->unsafe_data() + pos);
 
 		if (this->is_sso_mode())
-			this->_my_sso_ptr()->length8 += uint8_t(str_view.length());
+			this->_sso_set_length(this->_my_sso_ptr()->length8 + str_view.length());
 		else
-			this->_my_ref_ptr()->length32 += uint32_t(str_view.length());
+			this->_my_ref_ptr()->length32 += _REF_UINT(str_view.length());
 
 		this->do_ensure_end_ch0(ensure_end_ch0);
 	};
@@ -256,8 +305,8 @@ _NO_INLINE void ks_basic_xmutable_string_base<ELEM>::do_insert(size_t pos, const
 	}
 }
 
-template <class ELEM>
-_NO_INLINE void ks_basic_xmutable_string_base<ELEM>::do_insert(size_t pos, size_t count, ELEM ch, bool ch_valid, bool ensure_end_ch0) {
+template <class ELEM, class ALLOC>
+_NO_INLINE void ks_basic_xmutable_string_base<ELEM, ALLOC>::do_insert(size_t pos, size_t count, ELEM ch, bool ch_valid, bool ensure_end_ch0) {
 	if (pos > this->length())
 		throw std::out_of_range("ks_basic_xmutable_string_base::insert(pos, ...) out-of-range exception");
 	if (count == 0)
@@ -266,21 +315,21 @@ _NO_INLINE void ks_basic_xmutable_string_base<ELEM>::do_insert(size_t pos, size_
 	this->do_auto_grow(count);
 	this->do_ensure_exclusive();
 
-	std::move_backward(this->data() + pos, this->data() + pos + count, this->unsafe_data_end() + count);
+	std::move_backward(this->data() + pos, this->data_end(), this->unsafe_data_end() + count);
 
 	if (ch_valid)
 		std::fill_n(this->unsafe_data() + pos, count, ch);
 
 	if (this->is_sso_mode())
-		_my_sso_ptr()->length8 += uint8_t(count);
+		this->_sso_set_length(_my_sso_ptr()->length8 + count);
 	else
-		_my_ref_ptr()->length32 += uint32_t(count);
+		_my_ref_ptr()->length32 += _REF_UINT(count);
 
 	this->do_ensure_end_ch0(ensure_end_ch0);
 }
 
-template <class ELEM>
-_NO_INLINE void ks_basic_xmutable_string_base<ELEM>::do_replace(size_t pos, size_t number, const ks_basic_string_view<ELEM>& str_view, bool ensure_end_ch0) {
+template <class ELEM, class ALLOC>
+_NO_INLINE void ks_basic_xmutable_string_base<ELEM, ALLOC>::do_replace(size_t pos, size_t number, const ks_basic_string_view<ELEM>& str_view, bool ensure_end_ch0) {
 	if (ptrdiff_t(number) < 0)
 		number = this->length() - pos;
 
@@ -314,14 +363,14 @@ _NO_INLINE void ks_basic_xmutable_string_base<ELEM>::do_replace(size_t pos, size
 		if (len_delta < 0)
 			std::move(this->data() + pos_end, this->data_end(), this->unsafe_data() + pos_end + len_delta);
 		else if (len_delta > 0)
-			std::move_backward(this->data() + pos_end, this->data_end(), this->unsafe_data() + pos_end + len_delta);
+			std::move_backward(this->data() + pos_end, this->data_end(), this->unsafe_data_end() + len_delta);
 
 		std::copy_n(str_view.data(), str_view.length(), this->unsafe_data() + pos);
 
 		if (this->is_sso_mode())
-			this->_my_sso_ptr()->length8 += int8_t(len_delta);
+			this->_sso_set_length(this->_my_sso_ptr()->length8 + len_delta);
 		else
-			this->_my_ref_ptr()->length32 += int32_t(len_delta);
+			this->_my_ref_ptr()->length32 += _REF_UINT(len_delta);
 
 		this->do_ensure_end_ch0(ensure_end_ch0);
 	};
@@ -335,8 +384,8 @@ _NO_INLINE void ks_basic_xmutable_string_base<ELEM>::do_replace(size_t pos, size
 	}
 }
 
-template <class ELEM>
-_NO_INLINE void ks_basic_xmutable_string_base<ELEM>::do_replace(size_t pos, size_t number, size_t count, ELEM ch, bool ch_valid, bool ensure_end_ch0) {
+template <class ELEM, class ALLOC>
+_NO_INLINE void ks_basic_xmutable_string_base<ELEM, ALLOC>::do_replace(size_t pos, size_t number, size_t count, ELEM ch, bool ch_valid, bool ensure_end_ch0) {
 	if (ptrdiff_t(number) < 0)
 		number = this->length() - pos;
 
@@ -357,21 +406,21 @@ _NO_INLINE void ks_basic_xmutable_string_base<ELEM>::do_replace(size_t pos, size
 	if (len_delta < 0)
 		std::move(this->data() + pos_end, this->data_end(), this->unsafe_data() + pos_end + len_delta);
 	else if (len_delta > 0)
-		std::move_backward(this->data() + pos_end, this->data_end(), this->unsafe_data() + pos_end + len_delta);
+		std::move_backward(this->data() + pos_end, this->data_end(), this->unsafe_data_end() + len_delta);
 
 	if (ch_valid)
 		std::fill_n(this->unsafe_data() + pos, count, ch);
 
 	if (this->is_sso_mode())
-		_my_sso_ptr()->length8 += int8_t(len_delta);
+		this->_sso_set_length(_my_sso_ptr()->length8 + len_delta);
 	else
-		_my_ref_ptr()->length32 += int32_t(len_delta);
+		_my_ref_ptr()->length32 += _REF_UINT(len_delta);
 
 	this->do_ensure_end_ch0(ensure_end_ch0);
 }
 
-template <class ELEM>
-_NO_INLINE size_t ks_basic_xmutable_string_base<ELEM>::do_substitute_n(const ks_basic_string_view<ELEM>& sub, const ks_basic_string_view<ELEM>& replacement, size_t n, bool ensure_end_ch0) {
+template <class ELEM, class ALLOC>
+_NO_INLINE size_t ks_basic_xmutable_string_base<ELEM, ALLOC>::do_substitute_n(const ks_basic_string_view<ELEM>& sub, const ks_basic_string_view<ELEM>& replacement, size_t n, bool ensure_end_ch0) {
 	if (n == 0 || sub.empty())
 		return 0;
 
@@ -381,43 +430,43 @@ _NO_INLINE size_t ks_basic_xmutable_string_base<ELEM>::do_substitute_n(const ks_
 		return 0;
 
 	//collect all metches
-	std::vector<uint32_t> pos32_list;
-	pos32_list.reserve(4);
-	pos32_list.push_back(uint32_t(pos));
+	std::vector<_REF_UINT> pos_list;
+	pos_list.reserve(4);
+	pos_list.push_back(_REF_UINT(pos));
 
 	pos += sub.length();
 	for (size_t i = 1; i < n; ++i) {
 		pos = this->find(sub, pos);
 		if (ptrdiff_t(pos) < 0)
 			break;
-		pos32_list.push_back(uint32_t(pos));
+		pos_list.push_back(_REF_UINT(pos));
 		pos += sub.length();
 	}
 
 	//after all matches being collected, we check whether sub and replacement are equal, and if they are, we need do nothing.
 	if (sub == replacement)
-		return pos32_list.size();
+		return pos_list.size();
 
 	//one match only
-	if (pos32_list.size() == 1) {
-		this->do_replace(pos32_list[0], sub.length(), replacement, ensure_end_ch0);
+	if (pos_list.size() == 1) {
+		this->do_replace(pos_list[0], sub.length(), replacement, ensure_end_ch0);
 		return 1;
 	}
 
 	//multiple metches ...
-	ptrdiff_t len_delta_total = (ptrdiff_t)(replacement.length() - sub.length()) * (ptrdiff_t)(pos32_list.size());
+	ptrdiff_t len_delta_total = (ptrdiff_t)(replacement.length() - sub.length()) * (ptrdiff_t)(pos_list.size());
 	//if the final len is 0, we can do clear simply
 	if (len_delta_total > 0 && size_t(len_delta_total) == this->length()) {
 		this->do_clear(ensure_end_ch0);
-		return pos32_list.size();
+		return pos_list.size();
 	}
 
-	auto do_check_replacement_safe = [this, &pos32_list, len_delta_total](const ks_basic_string_view<ELEM>& replacement) -> bool {
+	auto do_check_replacement_safe = [this, &pos_list, len_delta_total](const ks_basic_string_view<ELEM>& replacement) -> bool {
 		if (len_delta_total == 0) {
 			//the len won't change ...
 			const auto this_view = this->view();
-			if (this->is_exclusive() && replacement.is_overlapped_with(this_view.unsafe_subview(pos32_list.front(), pos32_list.back() + replacement.length() - pos32_list.front()))) {
-				for (size_t pos : pos32_list) {
+			if (this->is_exclusive() && replacement.is_overlapped_with(this_view.unsafe_subview(pos_list.front(), pos_list.back() + replacement.length() - pos_list.front()))) {
+				for (size_t pos : pos_list) {
 					if (replacement.is_overlapped_with(this_view.unsafe_subview(pos, replacement.length()))) {
 						return false;
 					}
@@ -432,7 +481,7 @@ _NO_INLINE size_t ks_basic_xmutable_string_base<ELEM>::do_substitute_n(const ks_
 					//if strview is overlapped with this.wholeview, and this is exclusive, and need growing, it means that this.data will invalidate after growing, so we need clone strview
 					return false;
 				}
-				else if (replacement.is_overlapped_with(this->view().unsafe_subview(pos32_list.front(), this->length() + std::max(len_delta_total, ptrdiff_t(0)) - pos32_list.front()))) {
+				else if (replacement.is_overlapped_with(this->view().unsafe_subview(pos_list.front(), this->length() + std::max(len_delta_total, ptrdiff_t(0)) - pos_list.front()))) {
 					//if strview is overlapped with writing this.subview, and this is exclusive, and need growing, it means that this.data will invalidate after growing, so we need clone strview
 					return false;
 				}
@@ -442,7 +491,7 @@ _NO_INLINE size_t ks_basic_xmutable_string_base<ELEM>::do_substitute_n(const ks_
 		return true;
 	};
 
-	auto do_substitute_apply = [this, &pos32_list, sub_length = sub.length(), len_delta_total](const ks_basic_string_view<ELEM>& replacement, bool ensure_end_ch0) -> void {
+	auto do_substitute_apply = [this, &pos_list, sub_length = sub.length(), len_delta_total](const ks_basic_string_view<ELEM>& replacement, bool ensure_end_ch0) -> void {
 		if (len_delta_total > 0)
 			this->do_auto_grow(len_delta_total);
 		this->do_ensure_exclusive();
@@ -453,7 +502,7 @@ _NO_INLINE size_t ks_basic_xmutable_string_base<ELEM>::do_substitute_n(const ks_
 		if (len_delta_total == 0) {
 			//length no change, no shift
 			ASSERT(sub_length == replacement.length());
-			for (size_t pos : pos32_list) {
+			for (size_t pos : pos_list) {
 				std::copy_n(replacement.data(), sub_length, that_data + pos);
 			}
 		}
@@ -461,7 +510,7 @@ _NO_INLINE size_t ks_basic_xmutable_string_base<ELEM>::do_substitute_n(const ks_
 			//shrink, shift data to left
 			ELEM* write_p = that_data;
 			ELEM* read_p = that_data;
-			for (size_t pos : pos32_list) {
+			for (size_t pos : pos_list) {
 				ELEM* sub_p = that_data + pos;
 				if (read_p != write_p)
 					std::move(read_p, sub_p, write_p);
@@ -480,8 +529,8 @@ _NO_INLINE size_t ks_basic_xmutable_string_base<ELEM>::do_substitute_n(const ks_
 			//enlarge, shift data to right
 			ELEM* write_p_end = that_data_end + (+len_delta_total);
 			ELEM* read_p_end = that_data_end;
-			for (ptrdiff_t i = (ptrdiff_t)pos32_list.size() - 1; i >= 0; --i) {
-				ELEM* sub_p_end = that_data + pos32_list[i] + sub_length;
+			for (ptrdiff_t i = (ptrdiff_t)pos_list.size() - 1; i >= 0; --i) {
+				ELEM* sub_p_end = that_data + pos_list[i] + sub_length;
 				if (sub_p_end != write_p_end - (read_p_end - sub_p_end))
 					std::move_backward(sub_p_end, read_p_end, write_p_end);
 				write_p_end -= (read_p_end - sub_p_end);
@@ -498,9 +547,9 @@ _NO_INLINE size_t ks_basic_xmutable_string_base<ELEM>::do_substitute_n(const ks_
 
 		if (len_delta_total != 0) {
 			if (this->is_sso_mode())
-				this->_my_sso_ptr()->length8 += int8_t(len_delta_total);
+				this->_sso_set_length(this->_my_sso_ptr()->length8 + len_delta_total);
 			else
-				this->_my_ref_ptr()->length32 += int32_t(len_delta_total);
+				this->_my_ref_ptr()->length32 += _REF_UINT(len_delta_total);
 		}
 
 		this->do_ensure_end_ch0(ensure_end_ch0);
@@ -514,11 +563,11 @@ _NO_INLINE size_t ks_basic_xmutable_string_base<ELEM>::do_substitute_n(const ks_
 		do_substitute_apply(replacement, ensure_end_ch0);
 	}
 
-	return pos32_list.size();
+	return pos_list.size();
 }
 
-template <class ELEM>
-_NO_INLINE void ks_basic_xmutable_string_base<ELEM>::do_erase(size_t pos, size_t number, bool ensure_end_ch0) {
+template <class ELEM, class ALLOC>
+_NO_INLINE void ks_basic_xmutable_string_base<ELEM, ALLOC>::do_erase(size_t pos, size_t number, bool ensure_end_ch0) {
 	if (ptrdiff_t(number) < 0)
 		number = this->length() - pos;
 
@@ -537,18 +586,17 @@ _NO_INLINE void ks_basic_xmutable_string_base<ELEM>::do_erase(size_t pos, size_t
 	}
 
 	if (this->is_sso_mode())
-		_my_sso_ptr()->length8 -= uint8_t(number);
+		this->_sso_set_length(_my_sso_ptr()->length8 - number);
 	else
-		_my_ref_ptr()->length32 -= uint32_t(number);
+		_my_ref_ptr()->length32 -= _REF_UINT(number);
 
 	this->do_ensure_end_ch0(ensure_end_ch0);
 }
 
-template <class ELEM>
-_NO_INLINE void ks_basic_xmutable_string_base<ELEM>::do_clear(bool ensure_end_ch0) {
+template <class ELEM, class ALLOC>
+_NO_INLINE void ks_basic_xmutable_string_base<ELEM, ALLOC>::do_clear(bool ensure_end_ch0) {
 	if (this->is_sso_mode()) {
-		auto* sso_ptr = _my_sso_ptr();
-		sso_ptr->length8 = 0;
+		this->_sso_set_length(0);
 	}
 	else {
 		auto* ref_ptr = _my_ref_ptr();
@@ -558,16 +606,16 @@ _NO_INLINE void ks_basic_xmutable_string_base<ELEM>::do_clear(bool ensure_end_ch
 	this->do_ensure_end_ch0(ensure_end_ch0);
 }
 
-template <class ELEM>
+template <class ELEM, class ALLOC>
 template <class RIGHT, class _ /*= std::enable_if_t<std::is_convertible_v<RIGHT, ks_basic_string_view<ELEM>>>*/>
-_NO_INLINE void ks_basic_xmutable_string_base<ELEM>::do_self_add(RIGHT&& right, bool could_ref_right_data_directly, bool ensure_end_ch0) {
+_NO_INLINE void ks_basic_xmutable_string_base<ELEM, ALLOC>::do_self_add(RIGHT&& right, bool could_ref_right_data_directly, bool ensure_end_ch0) {
 	const ks_basic_string_view<ELEM> right_view = __to_basic_string_view(right);
 	bool will_ref_right_data_directly = false;
 	if (could_ref_right_data_directly && !right_view.empty() && this->empty()) {
-		if (std::is_base_of_v<ks_basic_xmutable_string_base<ELEM>, std::remove_cv_t<std::remove_reference_t<RIGHT>>> &&
-			static_cast<const ks_basic_xmutable_string_base<ELEM>&>(right).is_ref_mode())
+		if (std::is_base_of_v<ks_basic_xmutable_string_base<ELEM, ALLOC>, std::remove_cv_t<std::remove_reference_t<RIGHT>>> &&
+			static_cast<const ks_basic_xmutable_string_base<ELEM, ALLOC>&>(right).is_ref_mode())
 			will_ref_right_data_directly = true;
-		else if (std::is_same_v<RIGHT, std::basic_string<ELEM, std::char_traits<ELEM>, ks_basic_string_allocator<ELEM>>&&>)
+		else if (std::is_same_v<RIGHT, std::basic_string<ELEM, std::char_traits<ELEM>, ALLOC>&&>)
 			will_ref_right_data_directly = true;
 	}
 
@@ -579,23 +627,41 @@ _NO_INLINE void ks_basic_xmutable_string_base<ELEM>::do_self_add(RIGHT&& right,
 	this->do_ensure_end_ch0(ensure_end_ch0);
 
 	//ensure right detached
-	if (std::is_base_of_v<ks_basic_xmutable_string_base<ELEM>, std::remove_cv_t<std::remove_reference_t<RIGHT>>> &&
+	if (std::is_base_of_v<ks_basic_xmutable_string_base<ELEM, ALLOC>, std::remove_cv_t<std::remove_reference_t<RIGHT>>> &&
 		std::is_rvalue_reference_v<RIGHT&&> && !std::is_const_v<std::remove_reference_t<RIGHT>>) {
-		ks_basic_xmutable_string_base<ELEM>(std::forward<RIGHT>(right)).do_detach_void();
+		ks_basic_xmutable_string_base<ELEM, ALLOC>(std::forward<RIGHT>(right)).do_detach_void();
 	}
 }
 
 
-template <class ELEM>
-template <class STR_TYPE, class _ /*= std::enable_if_t<std::is_base_of_v<ks_basic_xmutable_string_base<ELEM>, STR_TYPE>>*/>
-_NO_INLINE std::vector<STR_TYPE> ks_basic_xmutable_string_base<ELEM>::do_split(const ks_basic_string_view<ELEM>& sep, size_t n) const {
+template <class ELEM, class ALLOC>
+template <class STR_TYPE, class _ /*= std::enable_if_t<std::is_base_of_v<ks_basic_xmutable_string_base<ELEM, ALLOC>, STR_TYPE>>*/>
+_NO_INLINE std::vector<STR_TYPE> ks_basic_xmutable_string_base<ELEM, ALLOC>::do_split(const ks_basic_string_view<ELEM>& sep, size_t n) const {
+	std::vector<ks_basic_string_view<ELEM>> sub_view_seq = this->view().split(sep, n);
+	return this->template do_bulk_substr<STR_TYPE>(sub_view_seq);
+}
+
+template <class ELEM, class ALLOC>
+template <class STR_TYPE, class _>
+_NO_INLINE std::vector<STR_TYPE> ks_basic_xmutable_string_base<ELEM, ALLOC>::do_bulk_substr(const std::vector<ks_basic_string_view<ELEM>>& sub_view_seq, bool may_copy_out) const {
 	const auto& this_view = this->view();
-	std::vector<ks_basic_string_view<ELEM>> sub_view_seq = this_view.split(sep, n);
+
+	//the refs are added when leaving, even if throws (the slices made are released then)
+	struct __batched_addref {
+		ELEM* alloc_addr;
+		size_t ref_count;
+		~__batched_addref() {
+			if (ref_count != 0)
+				ALLOC::_refcountful_addref_n(alloc_addr, ref_count);
+		}
+	};
 
 	std::vector<STR_TYPE> ret;
 	ret.reserve(sub_view_seq.size());
+	__batched_addref batched_addref{ this->is_ref_mode() ? _my_ref_ptr()->alloc_addr() : nullptr, 0 };
 	for (auto& sub_view : sub_view_seq) {
-		ret.push_back(this->unsafe_substr(sub_view.data() - this_view.data(), sub_view.length()));
+		ASSERT(sub_view.is_subview_of(this_view));
+		ret.push_back(this->unsafe_substr(sub_view.data() - this_view.data(), sub_view.length(), &batched_addref.ref_count, may_copy_out));
 	}
 
 	return ret;
@@ -603,28 +669,34 @@ _NO_INLINE std::vector<STR_TYPE> ks_basic_xmutable_string_base<ELEM>::do_split(c
 
 
 
-template <class LEFT, class ELEM, class _ = std::enable_if_t<std::is_convertible_v<LEFT, ks_basic_string_view<ELEM>>>>
-inline bool operator==(const LEFT& left, const ks_basic_xmutable_string_base<ELEM>& right) { return ks_basic_string_view<ELEM>(left) == right.view(); }
-template <class LEFT, class ELEM, class _ = std::enable_if_t<std::is_convertible_v<LEFT, ks_basic_string_view<ELEM>>>>
-inline bool operator!=(const LEFT& left, const ks_basic_xmutable_string_base<ELEM>& right) { return ks_basic_string_view<ELEM>(left) != right.view(); }
-template <class LEFT, class ELEM, class _ = std::enable_if_t<std::is_convertible_v<LEFT, ks_basic_string_view<ELEM>>>>
-inline bool operator<(const LEFT& left, const ks_basic_xmutable_string_base<ELEM>& right) { return ks_basic_string_view<ELEM>(left) < right.view(); }
-template <class LEFT, class ELEM, class _ = std::enable_if_t<std::is_convertible_v<LEFT, ks_basic_string_view<ELEM>>>>
-inline bool operator<=(const LEFT& left, const ks_basic_xmutable_string_base<ELEM>& right) { return ks_basic_string_view<ELEM>(left) <= right.view(); }
-template <class LEFT, class ELEM, class _ = std::enable_if_t<std::is_convertible_v<LEFT, ks_basic_string_view<ELEM>>>>
-inline bool operator>(const LEFT& left, const ks_basic_xmutable_string_base<ELEM>& right) { return ks_basic_string_view<ELEM>(left) > right.view(); }
-template <class LEFT, class ELEM, class _ = std::enable_if_t<std::is_convertible_v<LEFT, ks_basic_string_view<ELEM>>>>
-inline bool operator>=(const LEFT& left, const ks_basic_xmutable_string_base<ELEM>& right) { return ks_basic_string_view<ELEM>(left) >= right.view(); }
+template <class LEFT, class ELEM, class ALLOC, class _ = std::enable_if_t<std::is_convertible_v<LEFT, ks_basic_string_view<ELEM>>>>
+inline bool operator==(const LEFT& left, const ks_basic_xmutable_string_base<ELEM, ALLOC>& right) { return right.__equals(left); }
+template <class LEFT, class ELEM, class ALLOC, class _ = std::enable_if_t<std::is_convertible_v<LEFT, ks_basic_string_view<ELEM>>>>
+inline bool operator!=(const LEFT& left, const ks_basic_xmutable_string_base<ELEM, ALLOC>& right) { return !right.__equals(left); }
+template <class LEFT, class ELEM, class ALLOC, class _ = std::enable_if_t<std::is_convertible_v<LEFT, ks_basic_string_view<ELEM>>>>
+inline bool operator<(const LEFT& left, const ks_basic_xmutable_string_base<ELEM, ALLOC>& right) { return right.__compare(left) > 0; }
+template <class LEFT, class ELEM, class ALLOC, class _ = std::enable_if_t<std::is_convertible_v<LEFT, ks_basic_string_view<ELEM>>>>
+inline bool operator<=(const LEFT& left, const ks_basic_xmutable_string_base<ELEM, ALLOC>& right) { return right.__compare(left) >= 0; }
+template <class LEFT, class ELEM, class ALLOC, class _ = std::enable_if_t<std::is_convertible_v<LEFT, ks_basic_string_view<ELEM>>>>
+inline bool operator>(const LEFT& left, const ks_basic_xmutable_string_base<ELEM, ALLOC>& right) { return right.__compare(left) < 0; }
+template <class LEFT, class ELEM, class ALLOC, class _ = std::enable_if_t<std::is_convertible_v<LEFT, ks_basic_string_view<ELEM>>>>
+inline bool operator>=(const LEFT& left, const ks_basic_xmutable_string_base<ELEM, ALLOC>& right) { return right.__compare(left) <= 0; }
 
 
 namespace std {
-	template <class ELEM>
-	struct hash<ks_basic_xmutable_string_base<ELEM>> : hash<ks_basic_string_view<ELEM>> {
+	template <class ELEM, class ALLOC>
+	struct hash<ks_basic_xmutable_string_base<ELEM, ALLOC>> {
+		using argument_type = ks_basic_xmutable_string_base<ELEM, ALLOC>;
+		using result_type = size_t;
+
+		size_t operator()(const ks_basic_xmutable_string_base<ELEM, ALLOC>& str) const noexcept {
+			return str.__hash(); //the same as the hash of its view
+		}
 	};
 }
 
 
-template <class ELEM>
-inline std::basic_ostream<ELEM, std::char_traits<ELEM>>& operator<<(std::basic_ostream<ELEM, std::char_traits<ELEM>>& strm, const ks_basic_xmutable_string_base<ELEM>& str) {
+template <class ELEM, class ALLOC>
+inline std::basic_ostream<ELEM, std::char_traits<ELEM>>& operator<<(std::basic_ostream<ELEM, std::char_traits<ELEM>>& strm, const ks_basic_xmutable_string_base<ELEM, ALLOC>& str) {
 	return strm << str.view();
 }
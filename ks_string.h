@@ -24,7 +24,32 @@ using ks_immutable_string = ks_basic_immutable_string<char>;
 using ks_mutable_wstring = ks_basic_mutable_string<WCHAR>;
 using ks_immutable_wstring = ks_basic_immutable_string<WCHAR>;
 
+//thread-confined strings, see also ks_basic_string_local_allocator
+using ks_local_mutable_string = ks_basic_mutable_string<char, ks_basic_string_local_allocator<char>>;
+using ks_local_immutable_string = ks_basic_immutable_string<char, ks_basic_string_local_allocator<char>>;
+using ks_local_mutable_wstring = ks_basic_mutable_string<WCHAR, ks_basic_string_local_allocator<WCHAR>>;
+using ks_local_immutable_wstring = ks_basic_immutable_string<WCHAR, ks_basic_string_local_allocator<WCHAR>>;
+
+//strings of 32 bytes, which keep up to 29 chars or 14 WCHARs in sso (e.g. uuids and most identifiers), see also ks_basic_string_sso_allocator
+using ks_sso32_mutable_string = ks_basic_mutable_string<char, ks_basic_string_sso_allocator<char, 32>>;
+using ks_sso32_immutable_string = ks_basic_immutable_string<char, ks_basic_string_sso_allocator<char, 32>>;
+using ks_sso32_mutable_wstring = ks_basic_mutable_string<WCHAR, ks_basic_string_sso_allocator<WCHAR, 32>>;
+using ks_sso32_immutable_wstring = ks_basic_immutable_string<WCHAR, ks_basic_string_sso_allocator<WCHAR, 32>>;
+
+//strings of the wide layout, whose length and slices may be beyond 2GB (e.g. large log or corpus files), see also ks_basic_string_wide_allocator
+using ks_wide_mutable_string = ks_basic_mutable_string<char, ks_basic_string_wide_allocator<char>>;
+using ks_wide_immutable_string = ks_basic_immutable_string<char, ks_basic_string_wide_allocator<char>>;
+using ks_wide_mutable_wstring = ks_basic_mutable_string<WCHAR, ks_basic_string_wide_allocator<WCHAR>>;
+using ks_wide_immutable_wstring = ks_basic_immutable_string<WCHAR, ks_basic_string_wide_allocator<WCHAR>>;
+
+//strings whose sso unions are 16-aligned as the heap buffers (for the vectorized kernels), see also ks_basic_string_aligned_allocator
+using ks_aligned_mutable_string = ks_basic_mutable_string<char, ks_basic_string_aligned_allocator<char>>;
+using ks_aligned_immutable_string = ks_basic_immutable_string<char, ks_basic_string_aligned_allocator<char>>;
+using ks_aligned_mutable_wstring = ks_basic_mutable_string<WCHAR, ks_basic_string_aligned_allocator<WCHAR>>;
+using ks_aligned_immutable_wstring = ks_basic_immutable_string<WCHAR, ks_basic_string_aligned_allocator<WCHAR>>;
+
 #include "ks_string_util.h"
+#include "ks_string_shared_arena.h"
 
 
 //using ks_string  = ks_immutable_string;
@@ -0,0 +1,171 @@
+﻿/* Copyright 2024 The Kingsoft's modern-string Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "base.h"
+#include "ks_string_biased_refcount.h"
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <algorithm>
+#include <unordered_map>
+
+
+struct __ks_string_biased_release {
+	void* p;
+	void(*owner_release)(void*);
+	__ks_string_biased_release* next; //of the overflowed ones
+};
+
+static constexpr size_t QUEUE_CAPACITY = 64; //preallocated with the owner, the overflowed releases are allocated one by one
+
+struct __ks_string_biased_owner {
+	uint32_t token = 0;
+	__ks_string_biased_release queued_releases[QUEUE_CAPACITY]; //guarded by the registry mutex
+	size_t queued_count = 0; //guarded too
+	__ks_string_biased_release* overflowed_releases = nullptr; //guarded too
+	std::atomic<bool> has_queued{ false };
+};
+
+//note: these globals are never destructed, because strings may be released during static destruction
+static std::mutex& __registry_mutex() {
+	static std::mutex* s_mutex = new std::mutex();
+	return *s_mutex;
+}
+
+static std::unordered_map<uint32_t, __ks_string_biased_owner*>& __registered_owners() {
+	static auto* s_owners = new std::unordered_map<uint32_t, __ks_string_biased_owner*>();
+	return *s_owners;
+}
+
+static std::atomic<uint32_t> g_last_token{ 0 };
+
+
+static thread_local __ks_string_biased_owner* tls_owner = nullptr;
+static thread_local bool tls_owner_tried = false;
+
+static void __perform_queued_releases(__ks_string_biased_owner* owner) noexcept {
+	__ks_string_biased_release releases[QUEUE_CAPACITY];
+	size_t count = 0;
+	__ks_string_biased_release* overflowed = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(__registry_mutex());
+		count = owner->queued_count;
+		std::copy_n(owner->queued_releases, count, releases);
+		owner->queued_count = 0;
+		std::swap(overflowed, owner->overflowed_releases);
+		owner->has_queued.store(false, std::memory_order_relaxed);
+	}
+
+	//as the owner, out of the lock
+	for (size_t i = 0; i < count; ++i)
+		releases[i].owner_release(releases[i].p);
+	while (overflowed != nullptr) {
+		__ks_string_biased_release* next = overflowed->next;
+		overflowed->owner_release(overflowed->p);
+		delete overflowed;
+		overflowed = next;
+	}
+}
+
+struct __ks_string_biased_owner_guard {
+	~__ks_string_biased_owner_guard() {
+		__ks_string_biased_owner* owner = tls_owner;
+		if (owner == nullptr)
+			return;
+
+		//perform the queued releases until none, then quit being the owner, since then the biased counts are merged by the releasing threads
+		for (;;) {
+			__perform_queued_releases(owner);
+			std::lock_guard<std::mutex> lock(__registry_mutex());
+			if (owner->queued_count == 0 && owner->overflowed_releases == nullptr) {
+				__registered_owners().erase(owner->token);
+				ks_string_biased_refcount::__tls_token() = 0;
+				break;
+			}
+		}
+
+		tls_owner = nullptr;
+		delete owner;
+	}
+};
+
+static void __register_current_thread() {
+	static thread_local __ks_string_biased_owner_guard tls_guard;
+	(void)tls_guard;
+
+	uint32_t token = g_last_token.load(std::memory_order_relaxed);
+	do {
+		if (token >= ks_string_biased_refcount::MAX_TOKEN)
+			return; //run out of tokens, keep unbiased
+	} while (!g_last_token.compare_exchange_weak(token, token + 1, std::memory_order_relaxed));
+
+	auto* owner = new __ks_string_biased_owner();
+	owner->token = token + 1;
+	{
+		std::lock_guard<std::mutex> lock(__registry_mutex());
+		__registered_owners()[owner->token] = owner;
+	}
+	tls_owner = owner;
+	ks_string_biased_refcount::__tls_token() = owner->token;
+}
+
+
+uint32_t ks_string_biased_refcount::__acquire_token() noexcept {
+	__ks_string_biased_owner* owner = tls_owner;
+	if (owner == nullptr) {
+		if (tls_owner_tried)
+			return 0; //failed to register, or exited
+		tls_owner_tried = true;
+		try {
+			__register_current_thread();
+		}
+		catch (...) {
+		}
+		return __tls_token();
+	}
+
+	if (owner->has_queued.load(std::memory_order_relaxed))
+		__perform_queued_releases(owner);
+	return owner->token;
+}
+
+void ks_string_biased_refcount::perform_queued_releases() noexcept {
+	__ks_string_biased_owner* owner = tls_owner;
+	if (owner != nullptr && owner->has_queued.load(std::memory_order_relaxed))
+		__perform_queued_releases(owner);
+}
+
+bool ks_string_biased_refcount::__enqueue_release(uint32_t owner_token, void* p, void(*owner_release)(void*)) noexcept {
+	ASSERT(owner_token != 0);
+	std::lock_guard<std::mutex> lock(__registry_mutex());
+	auto it = __registered_owners().find(owner_token);
+	if (it == __registered_owners().end())
+		return false;
+
+	__ks_string_biased_owner* owner = it->second;
+	if (owner->queued_count < QUEUE_CAPACITY) {
+		owner->queued_releases[owner->queued_count++] = __ks_string_biased_release{ p, owner_release, nullptr };
+	}
+	else {
+		auto* release = new (std::nothrow) __ks_string_biased_release{ p, owner_release, owner->overflowed_releases };
+		if (release == nullptr) {
+			ASSERT(false);
+			return true; //out of memory, leak the reference rather than terminate
+		}
+		owner->overflowed_releases = release;
+	}
+	owner->has_queued.store(true, std::memory_order_relaxed);
+	return true;
+}
@@ -0,0 +1,53 @@
+﻿/* Copyright 2024 The Kingsoft's modern-string Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include "base.h"
+
+
+//the thread registry of biased refcounting (used by ks_basic_string_allocator if MODERN_STRING_BIASED_REFCOUNT_ENABLED).
+//a refcountful buffer is biased to the thread which allocates it (the owner): the owner counts its references in the biased count
+//by plain instructions, and other threads count theirs in the shared count by atomic instructions, they are merged when the biased count drops to 0.
+//a release that would drop the shared count below 0 is queued to the owner, who performs it at its next allocation, compacting or exit,
+//or it is performed by the releasing thread itself if the owner has exited. so the buffers queued to an idle owner are retained until then,
+//call perform_queued_releases in such a thread (e.g. when its event loop is idle) to bound it.
+//the queue is preallocated with the owner, the releases beyond it are allocated one by one, and are leaked if out of memory.
+//note: the tokens are never reused, the threads beyond MAX_TOKEN get token 0, and their buffers are refcounted atomically only.
+class MODERN_STRING_API ks_string_biased_refcount {
+public:
+    static constexpr uint32_t TOKEN_BITS = 24;
+    static constexpr uint32_t MAX_TOKEN = (1u << TOKEN_BITS) - 1;
+    static constexpr uint32_t MAX_BIASED_COUNT = 0xFF; //the rest references of owner are counted in the shared count
+    static constexpr uint32_t SHARED_OFFSET = 0x20000000; //the shared count is offset until merged, so that it's never negative
+
+    //the token of current thread, 0 if it has not allocated yet (or has exited)
+    static uint32_t current_token() noexcept { return __tls_token(); }
+
+    //perform the releases queued to current thread now (e.g. by a thread which rarely allocates)
+    static void perform_queued_releases() noexcept;
+
+public:
+    //register current thread lazily, and perform the releases queued to it, returns the token to bias new buffers to
+    static uint32_t __acquire_token() noexcept;
+
+    //queue a release to the owner, returns false if the owner has exited
+    static bool __enqueue_release(uint32_t owner_token, void* p, void(*owner_release)(void*)) noexcept;
+
+    static uint32_t& __tls_token() noexcept {
+        static thread_local uint32_t tls_token = 0;
+        return tls_token;
+    }
+};
@@ -0,0 +1,175 @@
+﻿/* Copyright 2024 The Kingsoft's modern-string Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "base.h"
+#include "ks_string_dedup.h"
+
+
+static constexpr size_t BATCH_SIZE = 256; //items processed per lock, so the owner thread is never blocked long
+static constexpr size_t PRUNE_INTERVAL = 64 * 1024; //items processed between prunes of the canonical table
+
+
+ks_string_dedup::ks_string_dedup(size_t min_length)
+	: m_min_length(std::max(min_length, ks_immutable_string().capacity() + 1)) { //the sso strings have no buffer to reclaim
+	m_thread = std::thread([this]() { this->do_work(); });
+}
+
+ks_string_dedup::~ks_string_dedup() noexcept {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_cond.notify_all();
+	m_thread.join();
+}
+
+bool ks_string_dedup::add(ks_immutable_string* str) {
+	ASSERT(str != nullptr);
+	if (str->length() < m_min_length || !str->owns_heap_buffer() || str->is_immortal())
+		return false; //the arena and external buffers are not freed by their owners, and must not be kept by the canonical table
+	if (!m_registered_set.insert(str).second)
+		return true; //queued already
+
+	_ITEM item{ str, *str };
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_item_queue.push_back(std::move(item));
+	}
+	m_cond.notify_all();
+	return true;
+}
+
+void ks_string_dedup::remove(ks_immutable_string* str) noexcept {
+	m_registered_set.erase(str); //its result (if any) is dropped by apply()
+}
+
+size_t ks_string_dedup::apply() {
+	std::vector<_RESULT> result_seq;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		result_seq.swap(m_result_seq);
+		m_prune_requested = true; //the canonical buffers whose strings all died are released on the background thread
+	}
+	m_cond.notify_all();
+
+#ifdef MODERN_STRING_BIASED_REFCOUNT_ENABLED
+	ks_string_biased_refcount::perform_queued_releases(); //the copies released by the background thread may be queued to this thread
+#endif
+
+	size_t reclaimed_bytes = 0;
+	for (_RESULT& result : result_seq) {
+		if (m_registered_set.erase(result.slot) == 0)
+			continue; //removed
+		ks_immutable_string* slot = result.slot;
+		if (result.canonical.empty() || slot->data() == result.canonical.data() || !(*slot == result.canonical.view()))
+			continue; //no duplicate, or changed since added
+
+		ks_immutable_string replaced = std::move(*slot);
+		*slot = result.canonical;
+		++m_deduplicated_count;
+		if (replaced.owns_heap_buffer() && replaced.is_exclusive())
+			reclaimed_bytes += replaced.length() + replaced.pinned_bytes(); //freed right now by the last owner
+	}
+
+	m_reclaimed_bytes += reclaimed_bytes;
+	return reclaimed_bytes;
+}
+
+void ks_string_dedup::flush() {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_cond.wait(lock, [this]() { return m_item_queue.empty() && m_processing_count == 0 && !m_prune_requested; });
+}
+
+void ks_string_dedup::do_work() noexcept {
+	std::vector<_ITEM> item_batch;
+	std::vector<_RESULT> result_batch;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_processing_count = 0;
+			for (_RESULT& result : result_batch)
+				m_result_seq.push_back(std::move(result));
+			result_batch.clear();
+			m_cond.notify_all(); //for flush()
+
+			m_cond.wait(lock, [this]() { return m_stopping || m_prune_requested || !m_item_queue.empty(); });
+			if (m_stopping)
+				break;
+			if (m_prune_requested && m_item_queue.empty()) {
+				m_prune_requested = false;
+				m_processing_count = 1; //for flush()
+				lock.unlock();
+				this->do_prune();
+				continue;
+			}
+
+			while (!m_item_queue.empty() && item_batch.size() < BATCH_SIZE) {
+				item_batch.push_back(std::move(m_item_queue.front()));
+				m_item_queue.pop_front();
+			}
+			m_processing_count = item_batch.size();
+		}
+
+		try {
+			this->do_process(item_batch, result_batch);
+		}
+		catch (...) {
+			//dedup is just best-effort, the unprocessed items are reported as no duplicate
+			for (size_t i = result_batch.size(); i < item_batch.size(); ++i)
+				result_batch.push_back(_RESULT{ item_batch[i].slot, ks_immutable_string() });
+		}
+		item_batch.clear(); //release the copies out of the lock
+	}
+
+	m_canonical_map.clear();
+}
+
+void ks_string_dedup::do_process(std::vector<_ITEM>& item_batch, std::vector<_RESULT>& result_batch) {
+	for (_ITEM& item : item_batch) {
+		auto iter = m_canonical_map.find(item.copy.view());
+		if (iter != m_canonical_map.end()) {
+			result_batch.push_back(_RESULT{ item.slot, iter->second });
+		}
+		else if (item.copy.pinned_bytes() > item.copy.length()) {
+			//a small slice of a large buffer, the duplicates (and itself) are re-pointed to an exact copy instead of pinning the buffer
+			ks_immutable_string canonical(item.copy.view());
+			const ks_string_view key = canonical.view();
+			m_canonical_map.emplace(key, canonical);
+			result_batch.push_back(_RESULT{ item.slot, std::move(canonical) });
+		}
+		else {
+			const ks_string_view key = item.copy.view();
+			m_canonical_map.emplace(key, item.copy);
+			result_batch.push_back(_RESULT{ item.slot, ks_immutable_string() });
+		}
+	}
+
+	m_processed_since_prune += item_batch.size();
+	if (m_processed_since_prune >= PRUNE_INTERVAL)
+		this->do_prune();
+}
+
+void ks_string_dedup::do_prune() {
+	m_processed_since_prune = 0;
+#ifdef MODERN_STRING_BIASED_REFCOUNT_ENABLED
+	ks_string_biased_refcount::perform_queued_releases(); //the copied canonical buffers are biased to this thread
+#endif
+	for (auto iter = m_canonical_map.begin(); iter != m_canonical_map.end(); ) {
+		if (iter->second.is_exclusive())
+			iter = m_canonical_map.erase(iter); //no other string refers it
+		else
+			++iter;
+	}
+}
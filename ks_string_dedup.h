@@ -0,0 +1,99 @@
+﻿/* Copyright 2024 The Kingsoft's modern-string Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include "ks_string.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+
+//opt-in deduplication of identical string buffers (like the string dedup of JVM).
+//the registered strings are hashed on a background thread incrementally, and the ones equal to an earlier string are found,
+//then apply() re-points them to the canonical buffer (on the owner thread), so that their own buffers are freed.
+//the strings are referred by pointer, add(), remove() and apply() must be called on one thread, which owns the registered strings,
+//and a registered string must be alive until it is applied or removed. the background thread works on its own copies only.
+//note: the canonical buffers are kept by the dedup table, until no other string refers them, then they are released by the prune after apply().
+//a small slice of a large buffer is not kept as canonical, an exact copy of it is kept instead (so the duplicates don't pin the large buffer).
+class MODERN_STRING_API ks_string_dedup {
+public:
+    static constexpr size_t DEFAULT_MIN_LENGTH = 32; //the short strings are not worth it (and the sso ones have no buffer)
+
+    explicit ks_string_dedup(size_t min_length = DEFAULT_MIN_LENGTH);
+    ~ks_string_dedup() noexcept;
+
+    ks_string_dedup(const ks_string_dedup&) = delete;
+    ks_string_dedup& operator=(const ks_string_dedup&) = delete;
+
+public:
+    //register a string to be deduplicated, returns false if ignored (too short, immortal, or not a heap buffer, e.g. an arena or external one)
+    bool add(ks_immutable_string* str);
+
+    //unregister a string before it dies or changes (no-op if not registered)
+    void remove(ks_immutable_string* str) noexcept;
+
+    //re-point the processed strings which have duplicates to their canonical buffers, returns the bytes reclaimed by this call
+    size_t apply();
+
+    //wait until the background thread has processed all the added strings (then apply() finishes them all), and the prune requested by apply()
+    void flush();
+
+    size_t pending_count() const noexcept { return m_registered_set.size(); }
+
+    size_t deduplicated_count() const noexcept { return m_deduplicated_count; }
+    size_t reclaimed_bytes() const noexcept { return m_reclaimed_bytes; }
+
+private:
+    struct _ITEM {
+        ks_immutable_string* slot;
+        ks_immutable_string copy; //for the background thread, keeps the buffer alive
+    };
+    struct _RESULT {
+        ks_immutable_string* slot;
+        ks_immutable_string canonical; //empty if no duplicate
+    };
+
+    void do_work() noexcept;
+    void do_process(std::vector<_ITEM>& item_batch, std::vector<_RESULT>& result_batch);
+    void do_prune();
+
+private:
+    const size_t m_min_length;
+
+    //the owner thread's
+    std::unordered_set<ks_immutable_string*> m_registered_set;
+    size_t m_deduplicated_count = 0;
+    size_t m_reclaimed_bytes = 0;
+
+    //the background thread's
+    std::unordered_map<ks_string_view, ks_immutable_string> m_canonical_map; //the keys view the canonical strings
+    size_t m_processed_since_prune = 0;
+
+    //shared, guarded by m_mutex
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<_ITEM> m_item_queue;
+    std::vector<_RESULT> m_result_seq;
+    size_t m_processing_count = 0;
+    bool m_prune_requested = false;
+    bool m_stopping = false;
+
+    std::thread m_thread;
+};
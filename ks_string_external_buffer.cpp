@@ -0,0 +1,113 @@
+﻿/* Copyright 2024 The Kingsoft's modern-string Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "base.h"
+#include "ks_string_external_buffer.h"
+#include <atomic>
+#include <mutex>
+#include <new>
+
+
+struct __ks_string_external_block {
+	std::atomic<uint32_t> refcount{ 0 };
+	uint32_t next_free = 0; //index + 1 of the next free block, guarded by the table mutex
+	const void* p = nullptr;
+	size_t size = 0;
+	ks_string_external_buffer::release_fn fn = nullptr;
+	void* ctx = nullptr;
+};
+
+static constexpr uint32_t CHUNK_BITS = 12;
+static constexpr uint32_t CHUNK_SIZE = 1u << CHUNK_BITS;
+static constexpr uint32_t CHUNK_COUNT = ks_string_external_buffer::MAX_BLOCK_COUNT / CHUNK_SIZE;
+
+//the chunks are allocated on demand and never freed, so a block is addressed without lock
+static std::atomic<__ks_string_external_block*> g_chunks[CHUNK_COUNT];
+static std::atomic<size_t> g_live_count{ 0 };
+
+//note: these globals are never destructed, because strings may be released during static destruction
+static std::mutex& __table_mutex() {
+	static std::mutex* s_mutex = new std::mutex();
+	return *s_mutex;
+}
+
+static uint32_t g_first_free = 0; //index + 1 of the first free block, guarded by the table mutex
+static uint32_t g_used_count = 0; //count of the blocks ever used, guarded by the table mutex
+
+
+static __ks_string_external_block* __get_block(uint32_t index) noexcept {
+	ASSERT(index < ks_string_external_buffer::MAX_BLOCK_COUNT);
+	__ks_string_external_block* chunk = g_chunks[index >> CHUNK_BITS].load(std::memory_order_acquire);
+	ASSERT(chunk != nullptr);
+	return &chunk[index & (CHUNK_SIZE - 1)];
+}
+
+
+size_t ks_string_external_buffer::live_count() noexcept {
+	return g_live_count.load(std::memory_order_relaxed);
+}
+
+uint32_t ks_string_external_buffer::__acquire_block(const void* p, size_t size, release_fn fn, void* ctx) {
+	uint32_t index;
+	{
+		std::lock_guard<std::mutex> lock(__table_mutex());
+		if (g_first_free != 0) {
+			index = g_first_free - 1;
+			g_first_free = __get_block(index)->next_free;
+		}
+		else {
+			if (g_used_count == MAX_BLOCK_COUNT)
+				throw std::bad_alloc();
+			index = g_used_count;
+			if ((index & (CHUNK_SIZE - 1)) == 0)
+				g_chunks[index >> CHUNK_BITS].store(new __ks_string_external_block[CHUNK_SIZE], std::memory_order_release);
+			++g_used_count;
+		}
+	}
+
+	__ks_string_external_block* block = __get_block(index);
+	block->p = p;
+	block->size = size;
+	block->fn = fn;
+	block->ctx = ctx;
+	block->refcount.store(1, std::memory_order_relaxed);
+	g_live_count.fetch_add(1, std::memory_order_relaxed);
+	return index;
+}
+
+void ks_string_external_buffer::__addref_block(uint32_t index) noexcept {
+	__ks_string_external_block* block = __get_block(index);
+	ASSERT(block->refcount.load(std::memory_order_relaxed) >= 1);
+	block->refcount.fetch_add(1, std::memory_order_relaxed);
+}
+
+size_t ks_string_external_buffer::__get_block_size(uint32_t index) noexcept {
+	return __get_block(index)->size;
+}
+
+void ks_string_external_buffer::__release_block(uint32_t index) noexcept {
+	__ks_string_external_block* block = __get_block(index);
+	ASSERT(block->refcount.load(std::memory_order_relaxed) >= 1);
+	if (block->refcount.fetch_sub(1, std::memory_order_acq_rel) != 1)
+		return;
+
+	if (block->fn != nullptr)
+		block->fn(block->p, block->size, block->ctx);
+	g_live_count.fetch_sub(1, std::memory_order_relaxed);
+
+	std::lock_guard<std::mutex> lock(__table_mutex());
+	block->next_free = g_first_free;
+	g_first_free = index + 1;
+}
@@ -0,0 +1,43 @@
+﻿/* Copyright 2024 The Kingsoft's modern-string Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include "base.h"
+
+
+//the control blocks of external buffers, which are adopted by immutable strings without copy (see also ks_basic_immutable_string::from_external).
+//a block holds the refcount of its buffer, and the release callback is called (on the thread releasing the last reference) when it drops to 0.
+//the strings refer a block by its index (instead of a heap header in front of the data), so that the string layout is kept.
+//note: at most MAX_BLOCK_COUNT external buffers can be alive at the same time.
+class MODERN_STRING_API ks_string_external_buffer {
+public:
+    using release_fn = void (*)(const void* p, size_t size, void* ctx);
+
+    static constexpr uint32_t INDEX_BITS = 24;
+    static constexpr uint32_t MAX_BLOCK_COUNT = 1u << INDEX_BITS;
+
+    //the count of external buffers alive
+    static size_t live_count() noexcept;
+
+public:
+    //the block of an external buffer of size bytes, with refcount 1, throws std::bad_alloc if no block is available
+    static uint32_t __acquire_block(const void* p, size_t size, release_fn fn, void* ctx);
+
+    static void __addref_block(uint32_t index) noexcept;
+    static void __release_block(uint32_t index) noexcept;
+
+    static size_t __get_block_size(uint32_t index) noexcept;
+};
@@ -0,0 +1,71 @@
+﻿/* Copyright 2024 The Kingsoft's modern-string Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include "base.h"
+#include <atomic>
+
+
+//policy of immortal string buffers, whose refcount is frozen, so that copying and destroying the strings of them never write the buffer header.
+//it's for the hot strings shared among threads (e.g. config keys and interned identifiers), an immortal buffer is never freed.
+//a buffer is made immortal explicitly (see also ks_basic_xmutable_string_base::make_immortal), or promoted automatically
+//when its refcount reaches promote_refcount, which is 0 by default, means never.
+//note: the refcount is checked only when it crosses a power of 2 (off the fast path of addref), so the buffer is promoted at the power of 2
+//not less than promote_refcount. and the buffers promoted automatically are never freed too, so their total bytes are capped by max_promoted_bytes.
+class MODERN_STRING_API ks_string_immortal_policy {
+public:
+    static constexpr size_t DEFAULT_MAX_PROMOTED_BYTES = 1024 * 1024;
+
+    static size_t promote_refcount() noexcept { return __promote_refcount().load(std::memory_order_relaxed); }
+    static void set_promote_refcount(size_t refcount) noexcept { __promote_refcount().store(refcount, std::memory_order_relaxed); }
+
+    static size_t max_promoted_bytes() noexcept { return __max_promoted_bytes().load(std::memory_order_relaxed); }
+    static void set_max_promoted_bytes(size_t bytes) noexcept { __max_promoted_bytes().store(bytes, std::memory_order_relaxed); }
+
+    //the total bytes of the buffers promoted automatically (the ones made immortal explicitly are not counted)
+    static size_t promoted_bytes() noexcept { return __promoted_bytes().load(std::memory_order_relaxed); }
+
+public:
+    //reserve the bytes of a buffer to promote, returns false if it would exceed max_promoted_bytes
+    static bool __reserve_promoted_bytes(size_t bytes) noexcept {
+        size_t old_bytes = __promoted_bytes().load(std::memory_order_relaxed);
+        do {
+            if (old_bytes + bytes > max_promoted_bytes())
+                return false;
+        } while (!__promoted_bytes().compare_exchange_weak(old_bytes, old_bytes + bytes, std::memory_order_relaxed));
+        return true;
+    }
+
+    static void __unreserve_promoted_bytes(size_t bytes) noexcept {
+        __promoted_bytes().fetch_sub(bytes, std::memory_order_relaxed);
+    }
+
+private:
+    static std::atomic<size_t>& __promote_refcount() noexcept {
+        static std::atomic<size_t> s_refcount{ 0 };
+        return s_refcount;
+    }
+
+    static std::atomic<size_t>& __max_promoted_bytes() noexcept {
+        static std::atomic<size_t> s_bytes{ DEFAULT_MAX_PROMOTED_BYTES };
+        return s_bytes;
+    }
+
+    static std::atomic<size_t>& __promoted_bytes() noexcept {
+        static std::atomic<size_t> s_bytes{ 0 };
+        return s_bytes;
+    }
+};
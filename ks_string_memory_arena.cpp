@@ -0,0 +1,123 @@
+﻿/* Copyright 2024 The Kingsoft's modern-string Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "base.h"
+#include "ks_string_memory_arena.h"
+#include <atomic>
+#include <new>
+#include <cstdlib>
+
+
+//every block is prefixed with its size, so that the chunks can be walked
+struct __ks_string_arena_block_prefix {
+	uint32_t block_size;
+	uint32_t reserved[3]; //keep the blocks aligned
+};
+
+struct ks_string_memory_arena::_CHUNK_HEADER {
+	_CHUNK_HEADER* next;
+	char* used_end;
+	char* end;
+	uint64_t __align_pad;
+};
+
+static_assert(sizeof(__ks_string_arena_block_prefix) == ks_string_memory_arena::BLOCK_ALIGNMENT, "the block prefix should keep the blocks aligned");
+
+
+ks_string_memory_arena::ks_string_memory_arena(size_t chunk_size) noexcept
+	: m_prev(__tls_current()), m_chunk_head(nullptr), m_cur_chunk(nullptr), m_cur_p(nullptr), m_cur_end(nullptr), m_chunk_size(chunk_size), m_allocated_bytes(0) {
+	__tls_current() = this;
+}
+
+ks_string_memory_arena::~ks_string_memory_arena() noexcept {
+	ASSERT(__tls_current() == this); //arenas must be destructed in reverse order
+	ASSERT(this->escaped_buffer_count() == 0); //strings allocated in arena must not escape the arena's scope
+	__tls_current() = m_prev;
+
+	_CHUNK_HEADER* chunk = m_chunk_head;
+	while (chunk != nullptr) {
+		_CHUNK_HEADER* next = chunk->next;
+		if (this->do_count_escaped(chunk) == 0)
+			free(chunk);
+		//else, the chunk is leaked on purpose (in release build), so that the escaped strings never dangle
+		chunk = next;
+	}
+}
+
+void* ks_string_memory_arena::allocate(size_t size) {
+	const size_t block_size = sizeof(__ks_string_arena_block_prefix) + ((size + BLOCK_ALIGNMENT - 1) & ~(BLOCK_ALIGNMENT - 1));
+	if (size_t(m_cur_end - m_cur_p) < block_size)
+		return this->do_allocate_slow(block_size);
+
+	auto* prefix = (__ks_string_arena_block_prefix*)m_cur_p;
+	prefix->block_size = uint32_t(block_size);
+	m_cur_p += block_size;
+	m_allocated_bytes += block_size;
+	return prefix + 1;
+}
+
+void* ks_string_memory_arena::do_allocate_slow(size_t block_size) {
+	if (block_size > 0xFFFFFFFFu)
+		throw std::bad_array_new_length();
+
+	//big blocks get a dedicated chunk, so the current chunk can still be used
+	const bool is_dedicated = block_size > m_chunk_size / 4;
+	const size_t chunk_alloc_size = sizeof(_CHUNK_HEADER) + (is_dedicated ? block_size : m_chunk_size);
+	auto* chunk = (_CHUNK_HEADER*)malloc(chunk_alloc_size);
+	if (chunk == nullptr)
+		throw std::bad_alloc();
+
+	chunk->end = (char*)chunk + chunk_alloc_size;
+	chunk->next = m_chunk_head;
+	m_chunk_head = chunk;
+
+	char* block_p = (char*)(chunk + 1);
+	if (is_dedicated) {
+		chunk->used_end = block_p + block_size;
+	}
+	else {
+		if (m_cur_chunk != nullptr)
+			m_cur_chunk->used_end = m_cur_p;
+		m_cur_chunk = chunk;
+		m_cur_p = block_p + block_size;
+		m_cur_end = chunk->end;
+	}
+
+	auto* prefix = (__ks_string_arena_block_prefix*)block_p;
+	prefix->block_size = uint32_t(block_size);
+	m_allocated_bytes += block_size;
+	return prefix + 1;
+}
+
+size_t ks_string_memory_arena::escaped_buffer_count() const noexcept {
+	size_t count = 0;
+	for (_CHUNK_HEADER* chunk = m_chunk_head; chunk != nullptr; chunk = chunk->next)
+		count += this->do_count_escaped(chunk);
+	return count;
+}
+
+size_t ks_string_memory_arena::do_count_escaped(_CHUNK_HEADER* chunk) const noexcept {
+	size_t count = 0;
+	char* p = (char*)(chunk + 1);
+	char* used_end = chunk == m_cur_chunk ? m_cur_p : chunk->used_end;
+	while (p < used_end) {
+		auto* prefix = (__ks_string_arena_block_prefix*)p;
+		uint32_t refcount = ((std::atomic<uint32_t>*)((char*)(prefix + 1) + REFCOUNT_OFFSET))->load(std::memory_order_acquire);
+		if (refcount != REFCOUNT_BIAS)
+			++count;
+		p += prefix->block_size;
+	}
+	return count;
+}
@@ -0,0 +1,87 @@
+﻿/* Copyright 2024 The Kingsoft's modern-string Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include "base.h"
+
+
+//scoped region for string buffers.
+//while an arena is alive (and is the innermost one) on a thread, the refcountful string buffers of this thread are bump-allocated from it,
+//and all of them are released at once when the arena is destructed.
+//note: the refcount of an arena buffer starts from REFCOUNT_BIAS, so it never drops to 0 and the buffer is never freed one by one.
+//      the addref and release of arena buffers are still atomic RMWs on the refcount, only the frees are saved.
+//note: strings must not escape the scope of the arena, it is asserted when the arena is destructed.
+//      in release build, the chunks holding escaped buffers are leaked instead of freed, so the escaped strings never dangle.
+//      use ks_string_memory_arena::heap_scope to make copies which can escape.
+class MODERN_STRING_API ks_string_memory_arena {
+public:
+    static constexpr size_t DEFAULT_CHUNK_SIZE = 64 * 1024;
+    static constexpr uint32_t REFCOUNT_BIAS = 0x40000000;
+    static constexpr size_t REFCOUNT_OFFSET = 8; //the refcount32 lies behind the reserved bytes of the string header
+    static constexpr size_t BLOCK_ALIGNMENT = 16;
+
+    explicit ks_string_memory_arena(size_t chunk_size = DEFAULT_CHUNK_SIZE) noexcept;
+    ~ks_string_memory_arena() noexcept;
+
+    ks_string_memory_arena(const ks_string_memory_arena&) = delete;
+    ks_string_memory_arena& operator=(const ks_string_memory_arena&) = delete;
+
+public:
+    //the innermost alive arena of current thread, or nullptr
+    static ks_string_memory_arena* current() noexcept { return __tls_current(); }
+
+    //allocate a string block (16-aligned) whose refcount32 lies at REFCOUNT_OFFSET
+    void* allocate(size_t size);
+
+    //count of buffers which are still referenced (should be 0 before the arena is destructed)
+    size_t escaped_buffer_count() const noexcept;
+
+    size_t allocated_bytes() const noexcept { return m_allocated_bytes; }
+
+public:
+    //suspend the arenas of current thread temporarily, so strings made in this scope are allocated from heap
+    class heap_scope {
+    public:
+        heap_scope() noexcept : m_suspended(__tls_current()) { __tls_current() = nullptr; }
+        ~heap_scope() noexcept { __tls_current() = m_suspended; }
+
+        heap_scope(const heap_scope&) = delete;
+        heap_scope& operator=(const heap_scope&) = delete;
+
+    private:
+        ks_string_memory_arena* m_suspended;
+    };
+
+private:
+    struct _CHUNK_HEADER;
+
+    void* do_allocate_slow(size_t block_size);
+    size_t do_count_escaped(_CHUNK_HEADER* chunk) const noexcept;
+
+    static ks_string_memory_arena*& __tls_current() noexcept {
+        static thread_local ks_string_memory_arena* tls_current = nullptr;
+        return tls_current;
+    }
+
+private:
+    ks_string_memory_arena* m_prev;
+    _CHUNK_HEADER* m_chunk_head;
+    _CHUNK_HEADER* m_cur_chunk;
+    char* m_cur_p;
+    char* m_cur_end;
+    size_t m_chunk_size;
+    size_t m_allocated_bytes;
+};
@@ -0,0 +1,98 @@
+﻿/* Copyright 2024 The Kingsoft's modern-string Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "base.h"
+#include "ks_string_memory_huge.h"
+#include <new>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+
+#if defined(__linux__)
+
+static size_t __mapped_size_of(size_t size) noexcept {
+	static const size_t s_page_size = size_t(sysconf(_SC_PAGESIZE));
+	return (size + s_page_size - 1) & ~(s_page_size - 1);
+}
+
+static void __advise_huge_pages(void* p, size_t mapped_size) noexcept {
+#ifdef MADV_HUGEPAGE
+	(void)madvise(p, mapped_size, MADV_HUGEPAGE); //just an advice, failure is ignored
+#else
+	(void)p;
+	(void)mapped_size;
+#endif
+}
+
+void* ks_string_memory_huge::allocate(size_t size) {
+	ASSERT(is_huge_size(size));
+	const size_t mapped_size = __mapped_size_of(size);
+	void* p = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		throw std::bad_alloc();
+
+	__advise_huge_pages(p, mapped_size);
+	return p;
+}
+
+void ks_string_memory_huge::deallocate(void* p, size_t size) noexcept {
+	ASSERT(p != nullptr);
+	ASSERT(is_huge_size(size));
+	(void)munmap(p, __mapped_size_of(size));
+}
+
+void* ks_string_memory_huge::reallocate(void* p, size_t old_size, size_t new_size) {
+	ASSERT(p != nullptr);
+	ASSERT(is_huge_size(old_size) && is_huge_size(new_size));
+	const size_t old_mapped_size = __mapped_size_of(old_size);
+	const size_t new_mapped_size = __mapped_size_of(new_size);
+	if (new_mapped_size == old_mapped_size)
+		return p;
+
+	void* new_p = mremap(p, old_mapped_size, new_mapped_size, MREMAP_MAYMOVE);
+	if (new_p == MAP_FAILED)
+		throw std::bad_alloc();
+
+	if (new_mapped_size > old_mapped_size)
+		__advise_huge_pages(new_p, new_mapped_size);
+	return new_p;
+}
+
+#else
+
+void* ks_string_memory_huge::allocate(size_t size) {
+	ASSERT(false);
+	(void)size;
+	throw std::bad_alloc();
+}
+
+void ks_string_memory_huge::deallocate(void* p, size_t size) noexcept {
+	ASSERT(false);
+	(void)p;
+	(void)size;
+}
+
+void* ks_string_memory_huge::reallocate(void* p, size_t old_size, size_t new_size) {
+	ASSERT(false);
+	(void)p;
+	(void)old_size;
+	(void)new_size;
+	throw std::bad_alloc();
+}
+
+#endif
@@ -0,0 +1,41 @@
+﻿/* Copyright 2024 The Kingsoft's modern-string Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include "base.h"
+
+
+//huge string buffers (alloc-size >= MODERN_STRING_HUGE_THRESHOLD) are mapped by anonymous mmap, and advised to use transparent huge pages.
+//they grow by mremap, so the pages are moved by the kernel instead of being copied, and the grown pages are zero-filled already.
+//note: it is enabled only if MODERN_STRING_HUGE_THRESHOLD is defined, and only on linux (mremap is required).
+class MODERN_STRING_API ks_string_memory_huge {
+public:
+#if defined(MODERN_STRING_HUGE_THRESHOLD) && defined(__linux__)
+    static constexpr size_t HUGE_THRESHOLD = MODERN_STRING_HUGE_THRESHOLD;
+#else
+    static constexpr size_t HUGE_THRESHOLD = 0; //disabled
+#endif
+
+    static constexpr bool is_huge_size(size_t size) noexcept {
+        return HUGE_THRESHOLD != 0 && size >= HUGE_THRESHOLD;
+    }
+
+    static void* allocate(size_t size);
+    static void deallocate(void* p, size_t size) noexcept;
+
+    //both old_size and new_size must be huge, the grown part is zero-filled (by kernel)
+    static void* reallocate(void* p, size_t old_size, size_t new_size);
+};
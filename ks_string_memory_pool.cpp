@@ -0,0 +1,236 @@
+﻿/* Copyright 2024 The Kingsoft's modern-string Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "base.h"
+#include "ks_string_memory_pool.h"
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+
+//size classes: 16-byte steps up to 128, then 4 steps per power of two up to MAX_POOLED_SIZE
+static constexpr size_t __SMALL_CLASS_LIMIT = 128;
+static constexpr size_t __SMALL_CLASS_COUNT = __SMALL_CLASS_LIMIT / 16;
+static constexpr size_t __CLASS_COUNT = __SMALL_CLASS_COUNT + 4 * 5; //(128, 4096] covers 5 powers of two
+
+static inline size_t __bit_width(size_t v) noexcept {
+	size_t n = 0;
+	while (v != 0) {
+		v >>= 1;
+		++n;
+	}
+	return n;
+}
+
+static inline size_t __class_index_of(size_t size) noexcept {
+	ASSERT(ks_string_memory_pool::is_pooled_size(size));
+	if (size <= __SMALL_CLASS_LIMIT)
+		return (size + 15) / 16 - 1;
+
+	const size_t e = __bit_width(size - 1) - 1;
+	const size_t q = (size - 1) >> (e - 2);
+	return __SMALL_CLASS_COUNT + (e - 7) * 4 + (q - 4);
+}
+
+static inline size_t __class_block_size(size_t class_index) noexcept {
+	ASSERT(class_index < __CLASS_COUNT);
+	if (class_index < __SMALL_CLASS_COUNT)
+		return (class_index + 1) * 16;
+
+	const size_t e = 7 + (class_index - __SMALL_CLASS_COUNT) / 4;
+	const size_t q = 4 + (class_index - __SMALL_CLASS_COUNT) % 4;
+	return (q + 1) << (e - 2);
+}
+
+static_assert(ks_string_memory_pool::MAX_POOLED_SIZE == (size_t(8) << 9), "the class table is designed for 4096 as max pooled size");
+
+
+struct __ks_string_pool;
+
+struct __ks_string_pool_free_node {
+	__ks_string_pool_free_node* next;
+};
+
+struct __ks_string_pool_slab {
+	__ks_string_pool* owner;
+	size_t class_index;
+};
+
+static constexpr size_t __SLAB_HEADER_SIZE = 64; //keep blocks 16-aligned, and away from the header's cache-line
+static_assert(sizeof(__ks_string_pool_slab) <= __SLAB_HEADER_SIZE, "the slab header is too large");
+
+struct __ks_string_pool {
+	__ks_string_pool_free_node* local_free[__CLASS_COUNT] = {};
+	std::atomic<__ks_string_pool_free_node*> remote_free[__CLASS_COUNT] = {};
+	__ks_string_pool* next_abandoned = nullptr;
+
+	void* pop(size_t class_index) {
+		__ks_string_pool_free_node* node = local_free[class_index];
+		if (node == nullptr) {
+			//take the whole remote-list lazily, only when the local-list is empty
+			node = remote_free[class_index].exchange(nullptr, std::memory_order_acquire);
+			if (node == nullptr)
+				node = this->carve_new_slab(class_index);
+		}
+
+		local_free[class_index] = node->next;
+		return node;
+	}
+
+	void push_local(size_t class_index, void* p) noexcept {
+		auto* node = (__ks_string_pool_free_node*)p;
+		node->next = local_free[class_index];
+		local_free[class_index] = node;
+	}
+
+	void push_remote(size_t class_index, void* p) noexcept {
+		auto* node = (__ks_string_pool_free_node*)p;
+		node->next = remote_free[class_index].load(std::memory_order_relaxed);
+		while (!remote_free[class_index].compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed))
+			;
+	}
+
+	__ks_string_pool_free_node* carve_new_slab(size_t class_index) {
+		void* slab_addr = nullptr;
+#ifdef _WIN32
+		slab_addr = _aligned_malloc(ks_string_memory_pool::SLAB_SIZE, ks_string_memory_pool::SLAB_SIZE);
+#else
+		if (posix_memalign(&slab_addr, ks_string_memory_pool::SLAB_SIZE, ks_string_memory_pool::SLAB_SIZE) != 0)
+			slab_addr = nullptr;
+#endif
+		if (slab_addr == nullptr)
+			throw std::bad_alloc();
+
+		auto* slab = (__ks_string_pool_slab*)slab_addr;
+		slab->owner = this;
+		slab->class_index = class_index;
+
+		//note: slabs are never returned to system, the pool is bounded by the peak usage
+		const size_t block_size = __class_block_size(class_index);
+		char* block_p = (char*)slab_addr + __SLAB_HEADER_SIZE;
+		char* const block_end = (char*)slab_addr + ks_string_memory_pool::SLAB_SIZE;
+		__ks_string_pool_free_node* head = nullptr;
+		__ks_string_pool_free_node** tail_link = &head;
+		for (; block_p + block_size <= block_end; block_p += block_size) {
+			auto* node = (__ks_string_pool_free_node*)block_p;
+			*tail_link = node;
+			tail_link = &node->next;
+		}
+		*tail_link = nullptr;
+
+		ASSERT(head != nullptr);
+		return head;
+	}
+};
+
+
+//the pools of exited threads are abandoned, and will be adopted by new threads (blocks in them may be still alive)
+//note: these globals are never destructed, because strings may be freed during static destruction
+static std::mutex& __abandoned_mutex() {
+	static std::mutex* s_mutex = new std::mutex();
+	return *s_mutex;
+}
+
+static __ks_string_pool*& __abandoned_head() {
+	static __ks_string_pool* s_head = nullptr;
+	return s_head;
+}
+
+//the fallback pool is used by the threads whose thread-local pool has been torn down, and is guarded by a mutex
+static std::mutex& __fallback_mutex() {
+	static std::mutex* s_mutex = new std::mutex();
+	return *s_mutex;
+}
+
+static __ks_string_pool& __fallback_pool() {
+	static __ks_string_pool* s_pool = new __ks_string_pool();
+	return *s_pool;
+}
+
+
+static thread_local __ks_string_pool* tls_pool = nullptr;
+static thread_local bool tls_pool_torn_down = false;
+
+struct __ks_string_pool_tls_guard {
+	~__ks_string_pool_tls_guard() {
+		__ks_string_pool* pool = tls_pool;
+		tls_pool = nullptr;
+		tls_pool_torn_down = true;
+		if (pool != nullptr) {
+			std::lock_guard<std::mutex> lock(__abandoned_mutex());
+			pool->next_abandoned = __abandoned_head();
+			__abandoned_head() = pool;
+		}
+	}
+};
+
+static __ks_string_pool* __acquire_tls_pool() {
+	__ks_string_pool* pool = tls_pool;
+	if (pool == nullptr && !tls_pool_torn_down) {
+		static thread_local __ks_string_pool_tls_guard tls_guard;
+		(void)tls_guard;
+
+		{
+			std::lock_guard<std::mutex> lock(__abandoned_mutex());
+			pool = __abandoned_head();
+			if (pool != nullptr)
+				__abandoned_head() = pool->next_abandoned;
+		}
+
+		if (pool == nullptr)
+			pool = new __ks_string_pool();
+
+		pool->next_abandoned = nullptr;
+		tls_pool = pool;
+	}
+
+	return pool;
+}
+
+
+void* ks_string_memory_pool::allocate(size_t size) {
+	ASSERT(is_pooled_size(size));
+	const size_t class_index = __class_index_of(size);
+
+	__ks_string_pool* pool = __acquire_tls_pool();
+	if (pool != nullptr)
+		return pool->pop(class_index);
+
+	std::lock_guard<std::mutex> lock(__fallback_mutex());
+	return __fallback_pool().pop(class_index);
+}
+
+void ks_string_memory_pool::deallocate(void* p, size_t size) noexcept {
+	ASSERT(p != nullptr);
+	ASSERT(is_pooled_size(size));
+
+	auto* slab = (__ks_string_pool_slab*)(uintptr_t(p) & ~uintptr_t(SLAB_SIZE - 1));
+	ASSERT(slab->class_index == __class_index_of(size));
+	(void)size;
+
+	if (slab->owner == tls_pool)
+		slab->owner->push_local(slab->class_index, p);
+	else
+		slab->owner->push_remote(slab->class_index, p);
+}
+
+size_t ks_string_memory_pool::block_size_of(size_t size) noexcept {
+	return __class_block_size(__class_index_of(size));
+}
@@ -0,0 +1,38 @@
+﻿/* Copyright 2024 The Kingsoft's modern-string Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include "base.h"
+
+
+//thread-local slab pool with size classes, for the small string buffers.
+//note: the size class of a block is determined by its alloc-size only, so the caller must pass the same size to allocate and deallocate.
+//note: a block freed by a non-owner thread is pushed onto the owner pool's remote-list, and will be reused lazily by the owner.
+class MODERN_STRING_API ks_string_memory_pool {
+public:
+    static constexpr size_t MAX_POOLED_SIZE = 4096;  //enough for 512 elements of 4-bytes ELEM, with header
+    static constexpr size_t SLAB_SIZE = 64 * 1024;   //slabs are aligned to SLAB_SIZE, so owner can be found by address
+
+    static constexpr bool is_pooled_size(size_t size) noexcept {
+        return size != 0 && size <= MAX_POOLED_SIZE;
+    }
+
+    static void* allocate(size_t size);
+    static void deallocate(void* p, size_t size) noexcept;
+
+    //the real block size of the size class which the size belongs to
+    static size_t block_size_of(size_t size) noexcept;
+};
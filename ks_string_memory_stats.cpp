@@ -0,0 +1,238 @@
+﻿/* Copyright 2024 The Kingsoft's modern-string Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "base.h"
+#include "ks_string_memory_stats.h"
+#include <atomic>
+#include <mutex>
+
+
+//counters of a thread, written by the owner thread only (so no lock-prefixed RMW is needed), and read by any thread when snapshot.
+//note: a buffer may be freed by a thread other than the allocator, so the per-thread values may be negative, only the sums make sense.
+struct __ks_string_stats_slot {
+	std::atomic<uint64_t> alloc_count{ 0 };
+	std::atomic<uint64_t> free_count{ 0 };
+	std::atomic<int64_t> alloc_bytes{ 0 };
+	std::atomic<int64_t> free_bytes{ 0 };
+	std::atomic<int64_t> live_buffer_histogram[ks_string_memory_stats::HISTOGRAM_SIZE] = {};
+
+	std::atomic<uint64_t> shared_slice_count{ 0 };
+	std::atomic<uint64_t> shared_slice_pinned_bytes{ 0 };
+	std::atomic<uint64_t> copied_out_slice_count{ 0 };
+	std::atomic<uint64_t> copied_out_slice_bytes{ 0 };
+
+	int64_t unflushed_live_bytes = 0; //guarded by the owner (or the fallback mutex)
+	bool is_shared = false;
+
+	__ks_string_stats_slot* next_registered = nullptr;
+	__ks_string_stats_slot* next_abandoned = nullptr;
+};
+
+template <class T>
+static inline void __bump(std::atomic<T>& counter, T n, bool is_shared) noexcept {
+	if (is_shared)
+		counter.fetch_add(n, std::memory_order_relaxed);
+	else
+		counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+static inline size_t __histogram_index_of(size_t alloc_size) noexcept {
+	ASSERT(alloc_size != 0);
+	size_t index = 0;
+	while ((alloc_size >>= 1) != 0)
+		++index;
+	return index < ks_string_memory_stats::HISTOGRAM_SIZE ? index : ks_string_memory_stats::HISTOGRAM_SIZE - 1;
+}
+
+
+//the live-bytes are flushed into the global counter in batches, only for tracking the peak
+//note: these globals are never destructed, because strings may be freed during static destruction
+static std::atomic<int64_t> g_flushed_live_bytes{ 0 };
+static std::atomic<int64_t> g_peak_bytes{ 0 };
+
+static void __flush_live_bytes(__ks_string_stats_slot* slot) noexcept {
+	const int64_t delta = slot->unflushed_live_bytes;
+	slot->unflushed_live_bytes = 0;
+
+	const int64_t live_bytes = g_flushed_live_bytes.fetch_add(delta, std::memory_order_relaxed) + delta;
+	int64_t peak_bytes = g_peak_bytes.load(std::memory_order_relaxed);
+	while (live_bytes > peak_bytes && !g_peak_bytes.compare_exchange_weak(peak_bytes, live_bytes, std::memory_order_relaxed))
+		;
+}
+
+//all slots are registered forever, the slots of exited threads are abandoned, and will be adopted by new threads
+static std::mutex& __registry_mutex() {
+	static std::mutex* s_mutex = new std::mutex();
+	return *s_mutex;
+}
+
+static __ks_string_stats_slot*& __registered_head() {
+	static __ks_string_stats_slot* s_head = nullptr;
+	return s_head;
+}
+
+static __ks_string_stats_slot*& __abandoned_head() {
+	static __ks_string_stats_slot* s_head = nullptr;
+	return s_head;
+}
+
+//the fallback slot is used by the threads whose thread-local slot has been torn down
+static std::mutex& __fallback_mutex() {
+	static std::mutex* s_mutex = new std::mutex();
+	return *s_mutex;
+}
+
+static __ks_string_stats_slot* __fallback_slot() {
+	static __ks_string_stats_slot* s_slot = [] {
+		auto* slot = new __ks_string_stats_slot();
+		slot->is_shared = true;
+		std::lock_guard<std::mutex> lock(__registry_mutex());
+		slot->next_registered = __registered_head();
+		__registered_head() = slot;
+		return slot;
+	}();
+	return s_slot;
+}
+
+
+static thread_local __ks_string_stats_slot* tls_slot = nullptr;
+static thread_local bool tls_slot_torn_down = false;
+
+struct __ks_string_stats_tls_guard {
+	~__ks_string_stats_tls_guard() {
+		__ks_string_stats_slot* slot = tls_slot;
+		tls_slot = nullptr;
+		tls_slot_torn_down = true;
+		if (slot != nullptr) {
+			__flush_live_bytes(slot);
+			std::lock_guard<std::mutex> lock(__registry_mutex());
+			slot->next_abandoned = __abandoned_head();
+			__abandoned_head() = slot;
+		}
+	}
+};
+
+static __ks_string_stats_slot* __acquire_tls_slot() {
+	__ks_string_stats_slot* slot = tls_slot;
+	if (slot == nullptr && !tls_slot_torn_down) {
+		static thread_local __ks_string_stats_tls_guard tls_guard;
+		(void)tls_guard;
+
+		std::lock_guard<std::mutex> lock(__registry_mutex());
+		slot = __abandoned_head();
+		if (slot != nullptr) {
+			__abandoned_head() = slot->next_abandoned;
+		}
+		else {
+			slot = new __ks_string_stats_slot();
+			slot->next_registered = __registered_head();
+			__registered_head() = slot;
+		}
+
+		slot->next_abandoned = nullptr;
+		tls_slot = slot;
+	}
+
+	return slot;
+}
+
+template <class FN>
+static void __record_into_slot(FN&& do_record) noexcept {
+	__ks_string_stats_slot* slot = nullptr;
+	try {
+		slot = __acquire_tls_slot();
+	}
+	catch (...) {
+		slot = nullptr; //failed to register, record into the fallback slot
+	}
+
+	if (slot != nullptr) {
+		do_record(slot);
+	}
+	else {
+		std::lock_guard<std::mutex> lock(__fallback_mutex());
+		do_record(__fallback_slot());
+	}
+}
+
+static void __record(size_t alloc_size, bool is_alloc) noexcept {
+	__record_into_slot([alloc_size, is_alloc](__ks_string_stats_slot* slot) {
+		const int64_t bytes = int64_t(alloc_size);
+		if (is_alloc) {
+			__bump(slot->alloc_count, uint64_t(1), slot->is_shared);
+			__bump(slot->alloc_bytes, bytes, slot->is_shared);
+		}
+		else {
+			__bump(slot->free_count, uint64_t(1), slot->is_shared);
+			__bump(slot->free_bytes, bytes, slot->is_shared);
+		}
+		__bump(slot->live_buffer_histogram[__histogram_index_of(alloc_size)], int64_t(is_alloc ? 1 : -1), slot->is_shared);
+
+		slot->unflushed_live_bytes += is_alloc ? bytes : -bytes;
+		if (slot->unflushed_live_bytes >= ks_string_memory_stats::FLUSH_BYTES || slot->unflushed_live_bytes <= -ks_string_memory_stats::FLUSH_BYTES)
+			__flush_live_bytes(slot);
+	});
+}
+
+
+void ks_string_memory_stats::__record_alloc(size_t alloc_size) noexcept {
+	__record(alloc_size, true);
+}
+
+void ks_string_memory_stats::__record_free(size_t alloc_size) noexcept {
+	__record(alloc_size, false);
+}
+
+void ks_string_memory_stats::__record_slice(size_t slice_size, size_t buffer_size, bool copied_out) noexcept {
+	__record_into_slot([slice_size, buffer_size, copied_out](__ks_string_stats_slot* slot) {
+		if (copied_out) {
+			__bump(slot->copied_out_slice_count, uint64_t(1), slot->is_shared);
+			__bump(slot->copied_out_slice_bytes, uint64_t(slice_size), slot->is_shared);
+		}
+		else {
+			__bump(slot->shared_slice_count, uint64_t(1), slot->is_shared);
+			__bump(slot->shared_slice_pinned_bytes, uint64_t(buffer_size - slice_size), slot->is_shared);
+		}
+	});
+}
+
+ks_string_memory_stats ks_string_memory_stats::__take_snapshot() {
+	ks_string_memory_stats stats;
+#ifdef MODERN_STRING_STATS_ENABLED
+	stats.enabled = true;
+
+	__fallback_slot(); //ensure registered
+	std::lock_guard<std::mutex> lock(__registry_mutex());
+	int64_t alloc_bytes = 0, free_bytes = 0;
+	for (__ks_string_stats_slot* slot = __registered_head(); slot != nullptr; slot = slot->next_registered) {
+		stats.alloc_count += slot->alloc_count.load(std::memory_order_relaxed);
+		stats.free_count += slot->free_count.load(std::memory_order_relaxed);
+		alloc_bytes += slot->alloc_bytes.load(std::memory_order_relaxed);
+		free_bytes += slot->free_bytes.load(std::memory_order_relaxed);
+		for (size_t i = 0; i < HISTOGRAM_SIZE; ++i)
+			stats.live_buffer_histogram[i] += slot->live_buffer_histogram[i].load(std::memory_order_relaxed);
+		stats.shared_slice_count += slot->shared_slice_count.load(std::memory_order_relaxed);
+		stats.shared_slice_pinned_bytes += slot->shared_slice_pinned_bytes.load(std::memory_order_relaxed);
+		stats.copied_out_slice_count += slot->copied_out_slice_count.load(std::memory_order_relaxed);
+		stats.copied_out_slice_bytes += slot->copied_out_slice_bytes.load(std::memory_order_relaxed);
+	}
+
+	stats.live_bytes = alloc_bytes - free_bytes;
+	stats.live_buffer_count = int64_t(stats.alloc_count - stats.free_count);
+	const int64_t peak_bytes = g_peak_bytes.load(std::memory_order_relaxed);
+	stats.peak_bytes = peak_bytes > stats.live_bytes ? peak_bytes : stats.live_bytes;
+#endif
+	return stats;
+}
@@ -0,0 +1,53 @@
+﻿/* Copyright 2024 The Kingsoft's modern-string Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include "base.h"
+
+
+//statistics of the string buffers allocated by ks_basic_string_allocator (the arena is not included).
+//the counters are recorded only if MODERN_STRING_STATS_ENABLED, and are accumulated per-thread, then merged when snapshot.
+//note: peak_bytes may lag behind the real peak by (thread-count * FLUSH_BYTES) at most.
+struct MODERN_STRING_API ks_string_memory_stats {
+    static constexpr size_t HISTOGRAM_SIZE = 32;
+    static constexpr int64_t FLUSH_BYTES = 64 * 1024;
+
+    bool enabled = false;
+
+    int64_t live_bytes = 0;
+    int64_t live_buffer_count = 0;
+    int64_t peak_bytes = 0;
+
+    uint64_t alloc_count = 0;
+    uint64_t free_count = 0;
+
+    //live_buffer_histogram[i] is the count of live buffers whose alloc-size is in [2^i, 2^(i+1))
+    int64_t live_buffer_histogram[HISTOGRAM_SIZE] = {};
+
+    //slices made from refcountful buffers (see also ks_string_slice_policy),
+    //the pinned bytes are the bytes of buffers not referenced by the shared slices, when they were made
+    uint64_t shared_slice_count = 0;
+    uint64_t shared_slice_pinned_bytes = 0;
+    uint64_t copied_out_slice_count = 0;
+    uint64_t copied_out_slice_bytes = 0;
+
+public:
+    static ks_string_memory_stats __take_snapshot();
+
+    static void __record_alloc(size_t alloc_size) noexcept;
+    static void __record_free(size_t alloc_size) noexcept;
+    static void __record_slice(size_t slice_size, size_t buffer_size, bool copied_out) noexcept;
+};
@@ -0,0 +1,81 @@
+﻿/* Copyright 2024 The Kingsoft's modern-string Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "base.h"
+#include "ks_string_memory_tag.h"
+#include <atomic>
+
+
+//every tag's entry lies in its own cache-line, so the tags won't contend with each other
+struct alignas(64) __ks_string_tag_entry {
+	std::atomic<int64_t> live_bytes{ 0 };
+	std::atomic<int64_t> peak_bytes{ 0 };
+	std::atomic<size_t> soft_limit{ 0 };
+};
+
+//note: these globals are trivially destructible, because strings may be freed during static destruction
+static __ks_string_tag_entry g_tag_entries[ks_string_memory_tag::MAX_TAG_COUNT];
+static std::atomic<ks_string_memory_tag::over_budget_callback> g_over_budget_callback{ nullptr };
+
+
+size_t ks_string_memory_tag::live_bytes(uint16_t tag) {
+	__check_tag(tag, "ks_string_memory_tag::live_bytes(tag) out-of-range exception");
+	const int64_t bytes = g_tag_entries[tag].live_bytes.load(std::memory_order_relaxed);
+	return bytes > 0 ? size_t(bytes) : 0;
+}
+
+size_t ks_string_memory_tag::peak_bytes(uint16_t tag) {
+	__check_tag(tag, "ks_string_memory_tag::peak_bytes(tag) out-of-range exception");
+	return size_t(g_tag_entries[tag].peak_bytes.load(std::memory_order_relaxed));
+}
+
+size_t ks_string_memory_tag::soft_limit(uint16_t tag) {
+	__check_tag(tag, "ks_string_memory_tag::soft_limit(tag) out-of-range exception");
+	return g_tag_entries[tag].soft_limit.load(std::memory_order_relaxed);
+}
+
+void ks_string_memory_tag::set_soft_limit(uint16_t tag, size_t limit) {
+	__check_tag(tag, "ks_string_memory_tag::set_soft_limit(tag) out-of-range exception");
+	g_tag_entries[tag].soft_limit.store(limit, std::memory_order_relaxed);
+}
+
+void ks_string_memory_tag::set_over_budget_callback(over_budget_callback callback) noexcept {
+	g_over_budget_callback.store(callback, std::memory_order_release);
+}
+
+void ks_string_memory_tag::__record_alloc(uint16_t tag, size_t alloc_size) noexcept {
+	ASSERT(tag != 0 && tag < MAX_TAG_COUNT);
+	__ks_string_tag_entry& entry = g_tag_entries[tag];
+	const int64_t old_bytes = entry.live_bytes.fetch_add(int64_t(alloc_size), std::memory_order_relaxed);
+	const int64_t new_bytes = old_bytes + int64_t(alloc_size);
+
+	int64_t peak_bytes = entry.peak_bytes.load(std::memory_order_relaxed);
+	while (new_bytes > peak_bytes && !entry.peak_bytes.compare_exchange_weak(peak_bytes, new_bytes, std::memory_order_relaxed))
+		;
+
+	const size_t limit = entry.soft_limit.load(std::memory_order_relaxed);
+	if (limit != 0 && old_bytes <= int64_t(limit) && new_bytes > int64_t(limit)) {
+		over_budget_callback callback = g_over_budget_callback.load(std::memory_order_acquire);
+		if (callback != nullptr) {
+			scope untagged(0); //the strings made by callback are not accounted to the tag (never throws for tag 0)
+			callback(tag, size_t(new_bytes), limit);
+		}
+	}
+}
+
+void ks_string_memory_tag::__record_free(uint16_t tag, size_t alloc_size) noexcept {
+	ASSERT(tag != 0 && tag < MAX_TAG_COUNT);
+	g_tag_entries[tag].live_bytes.fetch_sub(int64_t(alloc_size), std::memory_order_relaxed);
+}
@@ -0,0 +1,77 @@
+﻿/* Copyright 2024 The Kingsoft's modern-string Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include "base.h"
+#include <stdexcept>
+
+
+//allocation tags of string buffers, to account the memory per subsystem (tenant, pipeline stage ...).
+//while a tag scope is alive on a thread, the refcountful string buffers allocated by this thread are tagged (in the buffer header),
+//and their alloc-sizes are accounted to the tag until they are freed, no matter which thread frees them.
+//a soft limit can be set for a tag, and the over-budget callback is called when the tag's live bytes exceed it (allocation never fails for it).
+//note: tag 0 means untagged, and the arena buffers are not tagged. the tags not less than MAX_TAG_COUNT are rejected by std::out_of_range.
+class MODERN_STRING_API ks_string_memory_tag {
+public:
+    static constexpr size_t MAX_TAG_COUNT = 256;
+
+    using over_budget_callback = void(*)(uint16_t tag, size_t live_bytes, size_t soft_limit);
+
+    //the tag of current thread
+    static uint16_t current() noexcept { return __tls_current(); }
+
+    static size_t live_bytes(uint16_t tag);
+    static size_t peak_bytes(uint16_t tag);
+
+    //0 means no limit
+    static size_t soft_limit(uint16_t tag);
+    static void set_soft_limit(uint16_t tag, size_t limit);
+
+    //called on the allocating thread (untagged), once the live bytes of a tag grow across its soft limit
+    static void set_over_budget_callback(over_budget_callback callback) noexcept;
+
+public:
+    //tag the string buffers allocated in this scope on current thread
+    class scope {
+    public:
+        explicit scope(uint16_t tag) : m_prev(__tls_current()) {
+            __check_tag(tag, "ks_string_memory_tag::scope(tag) out-of-range exception");
+            __tls_current() = tag;
+        }
+        ~scope() noexcept { __tls_current() = m_prev; }
+
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+
+    private:
+        uint16_t m_prev;
+    };
+
+public:
+    static void __record_alloc(uint16_t tag, size_t alloc_size) noexcept;
+    static void __record_free(uint16_t tag, size_t alloc_size) noexcept;
+
+private:
+    static void __check_tag(uint16_t tag, const char* what) {
+        if (tag >= MAX_TAG_COUNT)
+            throw std::out_of_range(what);
+    }
+
+    static uint16_t& __tls_current() noexcept {
+        static thread_local uint16_t tls_current = 0;
+        return tls_current;
+    }
+};
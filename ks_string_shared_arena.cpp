@@ -0,0 +1,272 @@
+﻿/* Copyright 2024 The Kingsoft's modern-string Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "base.h"
+#include "ks_string_shared_arena.h"
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+//the layout of the shared memory: the header, then the entries of [uint32 length][chars][ch0], aligned to 4 bytes.
+//an offset refers the length field of an entry.
+struct ks_string_shared_arena::_ARENA_HEADER {
+	uint64_t magic;
+	uint64_t capacity;
+	std::atomic<uint64_t> used; //the bytes used from the arena's begin, including the header
+	uint64_t reserved;
+};
+
+static constexpr uint64_t ARENA_MAGIC = 0x414E5254534B534Bull; //"KSKSTRNA"
+static constexpr size_t ENTRY_ALIGNMENT = 4;
+
+static_assert(sizeof(ks_string_shared_arena::offset_type) == sizeof(uint32_t), "the entry length is uint32");
+
+
+#if defined(__linux__)
+
+static void __unmap_arena(const void* p, size_t size, void* ctx) {
+	(void)ctx;
+	(void)munmap(const_cast<void*>(p), size);
+}
+
+static size_t __mapped_size_of_fd(int fd) {
+	struct stat fd_stat;
+	if (fstat(fd, &fd_stat) != 0)
+		throw std::runtime_error("ks_string_shared_arena::attach() stat failure exception");
+	return size_t(fd_stat.st_size);
+}
+
+ks_string_shared_arena::ks_string_shared_arena(int fd, bool writable, size_t mapped_size)
+	: m_fd(fd), m_writable(writable) {
+	if (mapped_size < sizeof(_ARENA_HEADER) || mapped_size > MAX_CAPACITY) {
+		close(fd);
+		throw std::runtime_error("ks_string_shared_arena() invalid size exception");
+	}
+
+	void* p = mmap(nullptr, mapped_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		close(fd);
+		throw std::runtime_error("ks_string_shared_arena() mmap failure exception");
+	}
+
+	try {
+		m_mapping = ks_immutable_string::from_external((const char*)p, mapped_size, &__unmap_arena, nullptr);
+	}
+	catch (...) {
+		(void)munmap(p, mapped_size);
+		close(fd);
+		throw;
+	}
+}
+
+ks_string_shared_arena::ks_string_shared_arena(ks_string_shared_arena&& other) noexcept
+	: m_fd(other.m_fd), m_writable(other.m_writable), m_mapping(std::move(other.m_mapping)) {
+	other.m_fd = -1;
+	other.m_writable = false;
+}
+
+ks_string_shared_arena& ks_string_shared_arena::operator=(ks_string_shared_arena&& other) noexcept {
+	if (this != &other) {
+		if (m_fd != -1)
+			close(m_fd);
+		m_fd = other.m_fd;
+		m_writable = other.m_writable;
+		m_mapping = std::move(other.m_mapping);
+		other.m_fd = -1;
+		other.m_writable = false;
+	}
+	return *this;
+}
+
+ks_string_shared_arena::~ks_string_shared_arena() noexcept {
+	if (m_fd != -1)
+		close(m_fd); //the mapping is unmapped when the last string of it dies
+}
+
+ks_string_shared_arena ks_string_shared_arena::create(size_t capacity, const char* name) {
+	if (capacity < sizeof(_ARENA_HEADER) || capacity > MAX_CAPACITY)
+		throw std::overflow_error("ks_string_shared_arena::create(capacity) overflow exception");
+
+	const int fd = name != nullptr
+		? shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600)
+		: memfd_create("ks_string_shared_arena", MFD_CLOEXEC);
+	if (fd == -1)
+		throw std::runtime_error("ks_string_shared_arena::create() open failure exception");
+	if (ftruncate(fd, off_t(capacity)) != 0) {
+		close(fd);
+		if (name != nullptr)
+			(void)shm_unlink(name);
+		throw std::runtime_error("ks_string_shared_arena::create() truncate failure exception");
+	}
+
+	try {
+		ks_string_shared_arena arena(fd, true, capacity);
+		_ARENA_HEADER* header = arena.__header();
+		header->magic = ARENA_MAGIC;
+		header->capacity = capacity;
+		header->used.store(sizeof(_ARENA_HEADER), std::memory_order_release);
+		return arena;
+	}
+	catch (...) {
+		if (name != nullptr)
+			(void)shm_unlink(name);
+		throw;
+	}
+}
+
+ks_string_shared_arena ks_string_shared_arena::attach(int fd) {
+	const int dup_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+	if (dup_fd == -1)
+		throw std::runtime_error("ks_string_shared_arena::attach(fd) dup failure exception");
+
+	size_t mapped_size;
+	try {
+		mapped_size = __mapped_size_of_fd(dup_fd);
+	}
+	catch (...) {
+		close(dup_fd);
+		throw;
+	}
+
+	ks_string_shared_arena arena(dup_fd, false, mapped_size);
+	if (arena.__header()->magic != ARENA_MAGIC || arena.__header()->capacity != mapped_size)
+		throw std::runtime_error("ks_string_shared_arena::attach(fd) not an arena exception");
+	const uint64_t used = arena.__header()->used.load(std::memory_order_acquire);
+	if (used < sizeof(_ARENA_HEADER) || used > mapped_size)
+		throw std::runtime_error("ks_string_shared_arena::attach(fd) corrupt arena exception");
+	return arena;
+}
+
+ks_string_shared_arena ks_string_shared_arena::attach(const char* name) {
+	const int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+	if (fd == -1)
+		throw std::runtime_error("ks_string_shared_arena::attach(name) open failure exception");
+
+	ks_string_shared_arena arena = attach(fd);
+	close(fd);
+	return arena;
+}
+
+void ks_string_shared_arena::unlink(const char* name) noexcept {
+	(void)shm_unlink(name);
+}
+
+#else
+
+ks_string_shared_arena::ks_string_shared_arena(int fd, bool writable, size_t mapped_size)
+	: m_fd(fd), m_writable(writable) {
+	(void)mapped_size;
+	throw std::runtime_error("ks_string_shared_arena() not supported exception");
+}
+
+ks_string_shared_arena::ks_string_shared_arena(ks_string_shared_arena&& other) noexcept
+	: m_fd(other.m_fd), m_writable(other.m_writable), m_mapping(std::move(other.m_mapping)) {
+	other.m_fd = -1;
+	other.m_writable = false;
+}
+
+ks_string_shared_arena& ks_string_shared_arena::operator=(ks_string_shared_arena&& other) noexcept {
+	m_fd = other.m_fd;
+	m_writable = other.m_writable;
+	m_mapping = std::move(other.m_mapping);
+	return *this;
+}
+
+ks_string_shared_arena::~ks_string_shared_arena() noexcept {
+}
+
+ks_string_shared_arena ks_string_shared_arena::create(size_t capacity, const char* name) {
+	(void)name;
+	return ks_string_shared_arena(-1, true, capacity);
+}
+
+ks_string_shared_arena ks_string_shared_arena::attach(int fd) {
+	return ks_string_shared_arena(fd, false, 0);
+}
+
+ks_string_shared_arena ks_string_shared_arena::attach(const char* name) {
+	(void)name;
+	return ks_string_shared_arena(-1, false, 0);
+}
+
+void ks_string_shared_arena::unlink(const char* name) noexcept {
+	(void)name;
+}
+
+#endif
+
+
+ks_string_shared_arena::_ARENA_HEADER* ks_string_shared_arena::__header() const noexcept {
+	ASSERT(!m_mapping.empty());
+	return (_ARENA_HEADER*)m_mapping.data();
+}
+
+//the mapped size (0 if moved-from), which the header's capacity is checked to equal
+size_t ks_string_shared_arena::capacity() const noexcept {
+	return m_mapping.length();
+}
+
+//the header is in shared memory, which may be corrupted by other processes, so it's clamped to the mapping
+size_t ks_string_shared_arena::used_bytes() const noexcept {
+	if (m_mapping.empty())
+		return 0; //moved-from
+	return size_t(std::min(__header()->used.load(std::memory_order_acquire), uint64_t(m_mapping.length())));
+}
+
+ks_string_shared_arena::offset_type ks_string_shared_arena::add(const ks_string_view& str) {
+	if (!m_writable)
+		throw std::logic_error("ks_string_shared_arena::add(str) read-only exception");
+
+	_ARENA_HEADER* header = __header();
+	const size_t used = this->used_bytes();
+	const size_t entry_size = (sizeof(uint32_t) + str.length() + 1 + ENTRY_ALIGNMENT - 1) & ~(ENTRY_ALIGNMENT - 1);
+	if (str.length() > MAX_CAPACITY || entry_size > this->capacity() - used)
+		throw std::bad_alloc();
+
+	char* entry = const_cast<char*>(m_mapping.data()) + used;
+	const uint32_t length32 = uint32_t(str.length());
+	memcpy(entry, &length32, sizeof(uint32_t));
+	memcpy(entry + sizeof(uint32_t), str.data(), str.length());
+	entry[sizeof(uint32_t) + str.length()] = 0;
+	header->used.store(used + entry_size, std::memory_order_release); //publish the entry
+	return offset_type(used);
+}
+
+ks_string_view ks_string_shared_arena::view_at(offset_type offset) const {
+	const size_t used = this->used_bytes();
+	if (offset < sizeof(_ARENA_HEADER) || offset % ENTRY_ALIGNMENT != 0 || size_t(offset) + sizeof(uint32_t) + 1 > used)
+		throw std::out_of_range("ks_string_shared_arena::view_at(offset) out-of-range exception");
+
+	const char* entry = m_mapping.data() + offset;
+	uint32_t length32;
+	memcpy(&length32, entry, sizeof(uint32_t));
+	if (size_t(offset) + sizeof(uint32_t) + length32 + 1 > used) //the length and the end-ch0 are in range
+		throw std::out_of_range("ks_string_shared_arena::view_at(offset) out-of-range exception");
+	return ks_string_view(entry + sizeof(uint32_t), length32);
+}
+
+ks_immutable_string ks_string_shared_arena::string_at(offset_type offset) const {
+	const ks_string_view str_view = this->view_at(offset);
+	return m_mapping.substr(str_view.data() - m_mapping.data(), str_view.length()); //shares the mapping
+}
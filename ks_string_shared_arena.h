@@ -0,0 +1,73 @@
+﻿/* Copyright 2024 The Kingsoft's modern-string Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include "ks_string.h"
+
+
+//append-only string table in shared memory (memfd or shm_open), for sharing read-only strings across processes without copy. Linux only.
+//one process creates the arena and adds strings, then the others attach it (by the inherited fd, or by name), and get the strings by their offsets.
+//the offsets are position-independent, since the arena may be mapped at different addresses in different processes.
+//in every process, the mapping is kept alive by the arena object and the strings got from it (see also ks_basic_immutable_string::from_external),
+//and the shared memory is freed by the system after all processes unmapped it (and the named one is unlinked).
+//note: the added strings never change, but the arena should be created with enough capacity, it never grows.
+class MODERN_STRING_API ks_string_shared_arena {
+public:
+    using offset_type = uint32_t;
+    static constexpr size_t MAX_CAPACITY = 0x7FFFFFFF; //the max length of a string
+
+    //create an arena of capacity bytes, anonymous (memfd) if name is nullptr, or else named (shm_open, e.g. "/my-table")
+    static ks_string_shared_arena create(size_t capacity, const char* name = nullptr);
+
+    //attach an arena read-only, by the fd inherited from the creator process, or by name, throws std::runtime_error if it's not a valid arena
+    static ks_string_shared_arena attach(int fd);
+    static ks_string_shared_arena attach(const char* name);
+
+    //remove the name of a named arena, the attached ones are still valid
+    static void unlink(const char* name) noexcept;
+
+    ks_string_shared_arena(ks_string_shared_arena&& other) noexcept;
+    ks_string_shared_arena& operator=(ks_string_shared_arena&& other) noexcept;
+    ~ks_string_shared_arena() noexcept;
+
+    ks_string_shared_arena(const ks_string_shared_arena&) = delete;
+    ks_string_shared_arena& operator=(const ks_string_shared_arena&) = delete;
+
+public:
+    //add a string (by the creator only), returns its offset, throws std::bad_alloc if the arena is full
+    offset_type add(const ks_string_view& str);
+
+    //the string at offset, which shares the mapping (no copy), or the view of it, which is valid while the arena is alive
+    ks_immutable_string string_at(offset_type offset) const;
+    ks_string_view view_at(offset_type offset) const;
+
+    int fd() const noexcept { return m_fd; }
+    bool is_writable() const noexcept { return m_writable; }
+    size_t capacity() const noexcept;
+    size_t used_bytes() const noexcept;
+
+private:
+    struct _ARENA_HEADER;
+
+    ks_string_shared_arena(int fd, bool writable, size_t mapped_size);
+
+    _ARENA_HEADER* __header() const noexcept;
+
+private:
+    int m_fd;
+    bool m_writable;
+    ks_immutable_string m_mapping; //the whole mapping, adopted as an external buffer
+};
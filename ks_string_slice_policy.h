@@ -0,0 +1,70 @@
+﻿/* Copyright 2024 The Kingsoft's modern-string Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include "base.h"
+#include <atomic>
+
+
+//policy of slicing (substr, slice, split, trimmed ...) from refcountful string buffers, so that a small slice won't pin a huge buffer.
+//copy-out: a slice is copied out when it is made, if it covers less than 1/copy_out_ratio of the buffer.
+//compact: when the last but one owner of a buffer is released, the buffer is marked, and the last owner is compacted when its compact method is called,
+//         if it covers less than 1/compact_ratio of the buffer.
+//note: both are applied only to the buffers not smaller than min_buffer_size.
+//note: both ratios are 0 by default, which means never.
+class MODERN_STRING_API ks_string_slice_policy {
+public:
+    static constexpr size_t DEFAULT_MIN_BUFFER_SIZE = 64 * 1024;
+
+    static size_t copy_out_ratio() noexcept { return __copy_out_ratio().load(std::memory_order_relaxed); }
+    static void set_copy_out_ratio(size_t ratio) noexcept { __copy_out_ratio().store(ratio, std::memory_order_relaxed); }
+
+    static size_t compact_ratio() noexcept { return __compact_ratio().load(std::memory_order_relaxed); }
+    static void set_compact_ratio(size_t ratio) noexcept { __compact_ratio().store(ratio, std::memory_order_relaxed); }
+
+    static size_t min_buffer_size() noexcept { return __min_buffer_size().load(std::memory_order_relaxed); }
+    static void set_min_buffer_size(size_t size) noexcept { __min_buffer_size().store(size, std::memory_order_relaxed); }
+
+    static bool should_copy_out(size_t slice_size, size_t buffer_size) noexcept {
+        return __is_small_slice(slice_size, buffer_size, copy_out_ratio());
+    }
+
+    static bool should_compact(size_t slice_size, size_t buffer_size) noexcept {
+        return __is_small_slice(slice_size, buffer_size, compact_ratio());
+    }
+
+private:
+    static bool __is_small_slice(size_t slice_size, size_t buffer_size, size_t ratio) noexcept {
+        return ratio != 0
+            && buffer_size >= min_buffer_size()
+            && slice_size < buffer_size / ratio;
+    }
+
+    static std::atomic<size_t>& __copy_out_ratio() noexcept {
+        static std::atomic<size_t> s_ratio{ 0 };
+        return s_ratio;
+    }
+
+    static std::atomic<size_t>& __compact_ratio() noexcept {
+        static std::atomic<size_t> s_ratio{ 0 };
+        return s_ratio;
+    }
+
+    static std::atomic<size_t>& __min_buffer_size() noexcept {
+        static std::atomic<size_t> s_size{ DEFAULT_MIN_BUFFER_SIZE };
+        return s_size;
+    }
+};
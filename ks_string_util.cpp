@@ -15,6 +15,16 @@ limitations under the License.
 
 #include "base.h"
 #include "ks_string_util.h"
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 namespace ks_string_util {
 	//icase compare ...
@@ -70,4 +80,97 @@ namespace ks_string_util {
 		return __do_icase_equals<WCHAR>(left, right);
 	}
 
+	//file mapping ...
+#if defined(_WIN32)
+	static void __unmap_file(const void* p, size_t size, void* ctx) {
+		(void)size;
+		(void)ctx;
+		(void)UnmapViewOfFile(p);
+	}
+
+	template <class STR_TYPE>
+	static STR_TYPE __do_map_file(const char* path) {
+		HANDLE file_handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file_handle == INVALID_HANDLE_VALUE)
+			throw std::runtime_error("ks_string_util::map_file(path) open failure exception");
+
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(file_handle, &file_size)) {
+			CloseHandle(file_handle);
+			throw std::runtime_error("ks_string_util::map_file(path) stat failure exception");
+		}
+		if (file_size.QuadPart == 0) {
+			CloseHandle(file_handle);
+			return STR_TYPE();
+		}
+
+		HANDLE mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		CloseHandle(file_handle);
+		if (mapping_handle == nullptr)
+			throw std::runtime_error("ks_string_util::map_file(path) mmap failure exception");
+
+		void* p = MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping_handle); //the view keeps the mapping
+		if (p == nullptr)
+			throw std::runtime_error("ks_string_util::map_file(path) mmap failure exception");
+
+		try {
+			return STR_TYPE::from_external((const char*)p, size_t(file_size.QuadPart), &__unmap_file, nullptr);
+		}
+		catch (...) {
+			(void)UnmapViewOfFile(p);
+			throw;
+		}
+	}
+#else
+	static void __unmap_file(const void* p, size_t size, void* ctx) {
+		(void)ctx;
+		(void)munmap(const_cast<void*>(p), size);
+	}
+
+	template <class STR_TYPE>
+	static STR_TYPE __do_map_file(const char* path) {
+		const int fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (fd == -1)
+			throw std::runtime_error("ks_string_util::map_file(path) open failure exception");
+
+		struct stat file_stat;
+		if (fstat(fd, &file_stat) != 0) {
+			close(fd);
+			throw std::runtime_error("ks_string_util::map_file(path) stat failure exception");
+		}
+		if (file_stat.st_size == 0) {
+			close(fd);
+			return STR_TYPE();
+		}
+
+		const size_t file_size = size_t(file_stat.st_size);
+		void* p = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0); //no MAP_POPULATE, the pages are read in on first touch
+		close(fd); //the mapping keeps the file
+		if (p == MAP_FAILED)
+			throw std::runtime_error("ks_string_util::map_file(path) mmap failure exception");
+
+		try {
+			return STR_TYPE::from_external((const char*)p, file_size, &__unmap_file, nullptr);
+		}
+		catch (...) {
+			(void)munmap(p, file_size);
+			throw;
+		}
+	}
+#endif
+
+	ks_immutable_string map_file(const char* path) {
+		return __do_map_file<ks_immutable_string>(path);
+	}
+
+	ks_wide_immutable_string map_wide_file(const char* path) {
+		return __do_map_file<ks_wide_immutable_string>(path);
+	}
+
+	//memory stats ...
+	ks_string_memory_stats get_memory_stats() {
+		return ks_string_memory_stats::__take_snapshot();
+	}
+
 }
@@ -49,6 +49,22 @@ namespace ks_string_util {
 	MODERN_STRING_INLINE_API
 	ks_immutable_wstring concat(const T1& s1, const Ts&... sx);
 
+	//bulk ... (the strings share one buffer, which is allocated once, and freed when the last of them dies)
+	template <class IT, class _ = std::enable_if_t<std::is_convertible_v<decltype(*std::declval<IT>()), ks_string_view>>>
+	MODERN_STRING_INLINE_API
+	std::vector<ks_immutable_string> bulk_strings(IT first, IT last);
+	template <class IT, class _ = std::enable_if_t<std::is_convertible_v<decltype(*std::declval<IT>()), ks_wstring_view>>>
+	MODERN_STRING_INLINE_API
+	std::vector<ks_immutable_wstring> bulk_wstrings(IT first, IT last);
+
+	//the fill_fn(ELEM* p, size_t total_length, std::vector<ks_basic_string_view<ELEM>>& piece_seq) writes the buffer, and appends the subviews of it as the strings
+	template <class FILL_FN>
+	MODERN_STRING_INLINE_API
+	std::vector<ks_immutable_string> bulk_strings(size_t total_length, FILL_FN&& fill_fn);
+	template <class FILL_FN>
+	MODERN_STRING_INLINE_API
+	std::vector<ks_immutable_wstring> bulk_wstrings(size_t total_length, FILL_FN&& fill_fn);
+
 	//case convert ...
 	template <class STR_TYPE, class _ = std::enable_if_t<std::is_convertible_v<STR_TYPE, ks_string_view>>>
 	MODERN_STRING_INLINE_API
@@ -70,6 +86,20 @@ namespace ks_string_util {
 	MODERN_STRING_API
 	bool icase_equals(const ks_wstring_view& left, const ks_wstring_view& right);
 
+	//file mapping ...
+	//the whole file mapped read-only (paged in lazily), its slices keep the mapping alive, and it's unmapped when the last of them dies.
+	//note: the file must not be changed while mapped. throws std::runtime_error if failed, or std::overflow_error if too large for a string.
+	MODERN_STRING_API
+	ks_immutable_string map_file(const char* path);
+	//the same as map_file, but for the files beyond 2GB (see also ks_wide_immutable_string)
+	MODERN_STRING_API
+	ks_wide_immutable_string map_wide_file(const char* path);
+
+	//memory stats ...
+	//snapshot of the string buffers' allocation stats (all zero unless MODERN_STRING_STATS_ENABLED)
+	MODERN_STRING_API
+	ks_string_memory_stats get_memory_stats();
+
 }
 
 #include "ks_string_util.inl"
@@ -34,8 +34,8 @@ namespace ks_string_util {
 	inline bool __is_string_empty(const ks_basic_string_view<ELEM>& str_view) {
 		return str_view.empty();
 	}
-	template <class ELEM>
-	inline bool __is_string_empty(const ks_basic_xmutable_string_base<ELEM>& str) {
+	template <class ELEM, class ALLOC>
+	inline bool __is_string_empty(const ks_basic_xmutable_string_base<ELEM, ALLOC>& str) {
 		return str.empty();
 	}
 	template <class ELEM, class AllocType>
@@ -56,8 +56,8 @@ namespace ks_string_util {
 	inline ks_basic_string_view<ELEM> __to_string_view(const ks_basic_string_view<ELEM>& str_view) {
 		return str_view;
 	}
-	template <class ELEM>
-	inline ks_basic_string_view<ELEM> __to_string_view(const ks_basic_xmutable_string_base<ELEM>& str) {
+	template <class ELEM, class ALLOC>
+	inline ks_basic_string_view<ELEM> __to_string_view(const ks_basic_xmutable_string_base<ELEM, ALLOC>& str) {
 		return ks_basic_string_view<ELEM>(str);
 	}
 	template <class ELEM, class AllocType>
@@ -65,6 +65,16 @@ namespace ks_string_util {
 		return ks_basic_string_view<ELEM>(str);
 	}
 
+	//__to_immutable_string ... (shares the buffer if str is a immutable-able string already)
+	template <class ELEM, class T>
+	inline ks_basic_immutable_string<ELEM> __to_immutable_string(const T& str) {
+		return ks_basic_immutable_string<ELEM>(__to_string_view(str));
+	}
+	template <class ELEM>
+	inline ks_basic_immutable_string<ELEM> __to_immutable_string(const ks_basic_xmutable_string_base<ELEM>& str) {
+		return ks_basic_immutable_string<ELEM>(str);
+	}
+
 	//stringize ...
 	template <class T>
 	inline ks_immutable_string to_string(const T& v) {
@@ -103,7 +113,7 @@ namespace ks_string_util {
 			if (first == last)
 				return ks_basic_immutable_string<ELEM>();
 			if (first != last && std::next(first) == last)
-				return *first;
+				return __to_immutable_string<ELEM>(*first);
 		}
 
 		size_t total_len = 0;
@@ -119,16 +129,17 @@ namespace ks_string_util {
 			return ks_basic_immutable_string<ELEM>();
 
 		ks_basic_mutable_string<ELEM> mut_ret;
-		mut_ret.reserve(total_len);
-		mut_ret.append(prefix);
-
-		for (IT it = first; it != last; ++it) {
-			if (!sep.empty() && it != first)
-				mut_ret.append(sep);
-			mut_ret.append(__to_string_view(*it));
-		}
-
-		mut_ret.append(suffix);
+		mut_ret.resize_and_overwrite(total_len, [&](ELEM* p, size_t) -> size_t {
+			ELEM* p_end = std::copy_n(prefix.data(), prefix.length(), p);
+			for (IT it = first; it != last; ++it) {
+				if (!sep.empty() && it != first)
+					p_end = std::copy_n(sep.data(), sep.length(), p_end);
+				const auto item_view = __to_string_view(*it);
+				p_end = std::copy_n(item_view.data(), item_view.length(), p_end);
+			}
+			p_end = std::copy_n(suffix.data(), suffix.length(), p_end);
+			return p_end - p;
+		});
 		return std::move(mut_ret);
 	}
 
@@ -154,7 +165,7 @@ namespace ks_string_util {
 	template <class ELEM, class T1, class... Ts>
 	_NO_INLINE ks_basic_immutable_string<ELEM> __do_concat_va(const T1& s1, const Ts&... sx) {
 		if (sizeof...(sx) == 0)
-			return s1;
+			return __to_immutable_string<ELEM>(s1);
 		if (__is_string_empty(s1))
 			return __do_concat_va<ELEM>(sx...);
 
@@ -170,7 +181,7 @@ namespace ks_string_util {
 		}
 
 		if (is_sx_empty)
-			return s1;
+			return __to_immutable_string<ELEM>(s1);
 
 		str_view_arr[0] = __to_string_view(s1);
 		return __do_join<ELEM>(str_view_arr, str_view_arr + str_view_arr_size, ks_basic_string_view<ELEM>(), ks_basic_string_view<ELEM>(), ks_basic_string_view<ELEM>());
@@ -190,6 +201,41 @@ namespace ks_string_util {
 		return __do_concat_va<WCHAR>(s1, sx...);
 	}
 
+	//bulk ...
+	template <class ELEM, class IT>
+	_NO_INLINE std::vector<ks_basic_immutable_string<ELEM>> __do_bulk(IT first, IT last) {
+		size_t total_len = 0;
+		for (IT it = first; it != last; ++it)
+			total_len += __to_string_view(*it).length();
+
+		return ks_basic_immutable_string<ELEM>::__bulk_of(total_len, [first, last](ELEM* p, size_t, std::vector<ks_basic_string_view<ELEM>>& piece_seq) {
+			ELEM* p_end = p;
+			for (IT it = first; it != last; ++it) {
+				const auto item_view = __to_string_view(*it);
+				p_end = std::copy_n(item_view.data(), item_view.length(), p_end);
+				piece_seq.push_back(ks_basic_string_view<ELEM>(p_end - item_view.length(), item_view.length()));
+			}
+		});
+	}
+
+	template <class IT, class _ /*= std::enable_if_t<std::is_convertible_v<decltype(*std::declval<IT>()), ks_string_view>>*/>
+	inline std::vector<ks_immutable_string> bulk_strings(IT first, IT last) {
+		return __do_bulk<char>(first, last);
+	}
+	template <class IT, class _ /*= std::enable_if_t<std::is_convertible_v<decltype(*std::declval<IT>()), ks_wstring_view>>*/>
+	inline std::vector<ks_immutable_wstring> bulk_wstrings(IT first, IT last) {
+		return __do_bulk<WCHAR>(first, last);
+	}
+
+	template <class FILL_FN>
+	inline std::vector<ks_immutable_string> bulk_strings(size_t total_length, FILL_FN&& fill_fn) {
+		return ks_immutable_string::__bulk_of(total_length, std::forward<FILL_FN>(fill_fn));
+	}
+	template <class FILL_FN>
+	inline std::vector<ks_immutable_wstring> bulk_wstrings(size_t total_length, FILL_FN&& fill_fn) {
+		return ks_immutable_wstring::__bulk_of(total_length, std::forward<FILL_FN>(fill_fn));
+	}
+
 	//case convert ...
 	template <class ELEM, class STR_TYPE>
 	_NO_INLINE ks_basic_immutable_string<ELEM> __to_spec_case(STR_TYPE&& str, bool to_lower_or_upper) {